@@ -6,7 +6,10 @@
 #include "sphere.h"
 #include "cylinder.h"
 #include "rectangle.h"
+#include "obj_loader.h"
+#include "benchmark.h"
 #include <fstream>
+#include <map>
 #include "thirdparty/json.hpp"
 
 using json = nlohmann::json;
@@ -55,10 +58,13 @@ shared_ptr<material> parse_material(const json& j) {
 }
 
 
-Matrix4 parse_transformations(const json& j_transforms) {
-  Matrix4 M;
+// Compone las transformaciones en M y calcula su inversa M_inv. Devuelve false si
+// el resultado no es invertible (por ejemplo una escala 0), el objeto no se puede dibujar.
+bool parse_transformations(const json& j_transforms, Matrix4& M, Matrix4& M_inv) {
+  M = Matrix4();
+  M_inv = Matrix4();
 
-  if (!j_transforms.is_array()) return M;
+  if (!j_transforms.is_array()) return true;
 
   for (const auto& j_t : j_transforms) {
     std::string type = j_t.value("type", "");
@@ -97,7 +103,121 @@ Matrix4 parse_transformations(const json& j_transforms) {
     // Aplicamos las transformaciones en orden
     M = M * T_new;
   }
-  return M;
+
+  if (!Matrix4::affine_inverse(M, M_inv)) {
+    std::cerr << "Error: Las transformaciones dan una matriz singular: " << j_transforms.dump() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Textura de imagen de un objeto: "texture" es el archivo, "texture_filter" como se lee
+// (nearest por defecto, bilinear o trilinear) y "texture_layout" como se guarda en memoria
+// ("row_major" por defecto o "tiled")
+shared_ptr<texture> parse_texture(const json& j_obj) {
+  std::string file = j_obj.value("texture", "");
+  std::string name = j_obj.value("texture_filter", "nearest");
+  texture_filter filter = texture_filter::nearest;
+  if (name == "bilinear") filter = texture_filter::bilinear;
+  else if (name == "trilinear") filter = texture_filter::trilinear;
+  else if (name != "nearest") std::cerr << "Aviso: Filtro de textura desconocido " << name << ", se usa nearest" << std::endl;
+  std::string layout = j_obj.value("texture_layout", "row_major");
+  if (layout != "row_major" && layout != "tiled")
+    std::cerr << "Aviso: Distribucion de textura desconocida " << layout << ", se usa row_major" << std::endl;
+  return make_shared<image_texture>(file.c_str(), filter, layout == "tiled");
+}
+
+// Crea la geometria de una entrada de "objects" o "definitions", con sus transformaciones.
+// Devuelve nullptr si la entrada no es valida.
+shared_ptr<hittable> parse_object(const json& j_obj, const std::map<std::string, shared_ptr<hittable>>& definitions) {
+  std::string type = j_obj.value("type", "unknown");
+
+  // Instancia de una definicion: comparte su geometria, solo agrega la transformacion
+  if (type == "instance") {
+    std::string ref = j_obj.value("ref", "");
+    auto it = definitions.find(ref);
+    if (it == definitions.end()) {
+      std::cerr << "Error: No existe la definicion " << ref << std::endl;
+      return nullptr;
+    }
+    if (j_obj.contains("transforms") && j_obj["transforms"].is_array()) {
+      Matrix4 M, M_inv;
+      if (!parse_transformations(j_obj["transforms"], M, M_inv)) return nullptr;
+      return make_shared<affine_transform>(it->second, M, M_inv);
+    }
+    return it->second;
+  }
+
+  if (!j_obj.contains("material")) return nullptr;
+  
+  shared_ptr<material> mat = parse_material(j_obj["material"]);
+			shared_ptr<hittable> geometry_base = nullptr;
+  
+  // Esfera
+  if (type == "sphere") {
+    point3 center = parse_color(j_obj.value("center", json::array({0, 0, 0})));
+    double radius = j_obj.value("radius", 1.0);
+				if(j_obj.contains("texture")){
+					auto surface = make_shared<lambertian>(parse_texture(j_obj));
+    	geometry_base = make_shared<sphere>(center, radius, surface);
+				}
+				else{
+					geometry_base = make_shared<sphere>(center, radius, mat);
+				}
+  } 
+
+  // Cilindro
+  else if (type == "cylinder") {
+    point3 center = parse_color(j_obj.value("center", json::array({0, 0, 0})));
+    double radius = j_obj.value("radius", 1.0);
+    double height = j_obj.value("height", 2.0);
+				geometry_base = make_shared<cylinder>(center, radius, height, mat);
+  }
+
+  // Caja
+  else if (type == "box") {
+    point3 p0 = parse_color(j_obj.value("p0", json::array({-1, -1, -1})));
+    point3 p1 = parse_color(j_obj.value("p1", json::array({1, 1, 1})));
+				geometry_base = make_shared<box>(p0, p1, mat);
+  }
+			else if (type == "xz_rect"){
+				double x0 = j_obj.value("x0", 1.0);
+				double x1 = j_obj.value("x1", 1.0);
+				double z0 = j_obj.value("z0", 1.0);
+				double z1 = j_obj.value("z1", 1.0);
+				double k = j_obj.value("k", 1.0);
+				geometry_base = make_shared<xz_rect>(x0,x1,z0,z1,k,mat);
+			}
+			else if (type == "xy_rect"){
+				double x0 = j_obj.value("x0", 1.0);
+				double x1 = j_obj.value("x1", 1.0);
+				double y0 = j_obj.value("y0", 1.0);
+				double y1 = j_obj.value("y1", 1.0);
+				double k = j_obj.value("k", 1.0);
+				geometry_base = make_shared<xy_rect>(x0,x1,y0,y1,k,mat);
+			}
+			else if (type == "yz_rect"){
+				double y0 = j_obj.value("y0", 1.0);
+				double y1 = j_obj.value("y1", 1.0);
+				double z0 = j_obj.value("z0", 1.0);
+				double z1 = j_obj.value("z1", 1.0);
+				double k = j_obj.value("k", 1.0);
+				geometry_base = make_shared<yz_rect>(y0,y1,z0,z1,k,mat);
+			}
+			// Malla de triangulos desde un OBJ, la ruta es relativa a la carpeta scenes
+			else if (type == "mesh"){
+				std::string file = j_obj.value("file", "");
+				if(j_obj.contains("texture")){
+					mat = make_shared<lambertian>(parse_texture(j_obj));
+				}
+				geometry_base = load_obj("scenes/" + file, mat);
+			}
+			if (geometry_base && j_obj.contains("transforms") && j_obj["transforms"].is_array()) {
+    Matrix4 M, M_inv;
+    if (!parse_transformations(j_obj["transforms"], M, M_inv)) return nullptr;
+    return make_shared<affine_transform>(geometry_base, M, M_inv);
+  }
+  return geometry_base;
 }
 
 /*
@@ -295,6 +415,24 @@ void escena_infinita() {
 
 // Todo lo anterior son escenas precargadas
 
+// Huella de la escena para el punto de control (FNV-1a del JSON). Se quitan los
+// ajustes de la camara que no cambian la imagen, asi reanudar con otro numero de
+// hilos o con "resume" activado sigue aceptando el punto de control.
+uint64_t scene_fingerprint(json data) {
+  if (data.contains("camera") && data["camera"].is_object()) {
+    for (const char* key : {"threads", "tile_size", "progressive", "pass_samples", "preview_passes",
+                            "preview_seconds", "checkpoint", "resume"})
+      data["camera"].erase(key);
+  }
+
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data.dump()) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
 void leer_escena(std::string s){
 	hittable_list world;
   
@@ -320,8 +458,34 @@ void leer_escena(std::string s){
     cam.image_width       = j_cam.value("image_width", cam.image_width);
     cam.samples_per_pixel = j_cam.value("samples_per_pixel", cam.samples_per_pixel);
     cam.max_depth         = j_cam.value("max_depth", cam.max_depth);
+    cam.rr_depth          = j_cam.value("rr_depth", cam.rr_depth);
     cam.vfov              = j_cam.value("vfov", cam.vfov);
     cam.aspect_ratio      = j_cam.value("aspect_ratio", cam.aspect_ratio);
+    cam.num_threads       = j_cam.value("threads", cam.num_threads);
+    cam.tile_size         = j_cam.value("tile_size", cam.tile_size);
+    cam.seed              = j_cam.value("seed", cam.seed);
+    cam.wavefront         = j_cam.value("wavefront", cam.wavefront);
+    cam.progressive       = j_cam.value("progressive", cam.progressive);
+    cam.pass_samples      = j_cam.value("pass_samples", cam.pass_samples);
+    cam.preview_passes    = j_cam.value("preview_passes", cam.preview_passes);
+    cam.preview_seconds   = j_cam.value("preview_seconds", cam.preview_seconds);
+    cam.checkpoint_file   = j_cam.value("checkpoint", cam.checkpoint_file);
+    cam.resume            = j_cam.value("resume", cam.resume);
+    cam.light_sampling       = j_cam.value("light_sampling", cam.light_sampling);
+    cam.adaptive             = j_cam.value("adaptive", cam.adaptive);
+    cam.adaptive_min_samples = j_cam.value("adaptive_min_samples", cam.adaptive_min_samples);
+    cam.adaptive_batch       = j_cam.value("adaptive_batch", cam.adaptive_batch);
+    cam.adaptive_threshold   = j_cam.value("adaptive_threshold", cam.adaptive_threshold);
+    cam.adaptive_max_factor  = j_cam.value("adaptive_max_factor", cam.adaptive_max_factor);
+
+    // Tope de memoria para las texturas .rtt, que con tope se leen por bloques (0 = sin tope)
+    double texture_memory_mb = j_cam.value("texture_memory_mb", 0.0);
+    tile_cache::set_budget(size_t(std::fmax(texture_memory_mb, 0.0) * 1024 * 1024));
+
+    std::string accel = j_cam.value("accel", std::string("linear_bvh"));
+    if (accel == "none")     cam.accel = camera::accel_type::none;
+    else if (accel == "bvh") cam.accel = camera::accel_type::bvh;
+    else                     cam.accel = camera::accel_type::linear_bvh;
     
     // Lectura de vectores y colores 
     if (j_cam.contains("background")) cam.background = parse_color(j_cam["background"]);
@@ -330,88 +494,58 @@ void leer_escena(std::string s){
     if (j_cam.contains("vup")) cam.vup = parse_color(j_cam["vup"]);
   }
 
-  // Procesar objetos
-  if (data.contains("objects") && data["objects"].is_array()) {
-    for (const auto& j_obj : data["objects"]) {
-      std::string type = j_obj.value("type", "unknown");
-			std::string texture;
-      if (!j_obj.contains("material")) continue;
-			if(j_obj.contains("texture")) texture = j_obj.value("texture", "");
-      
-      shared_ptr<material> mat = parse_material(j_obj["material"]);
-			shared_ptr<hittable> geometry_base = nullptr;
-      
-      // Esfera
-      if (type == "sphere") {
-        point3 center = parse_color(j_obj.value("center", json::array({0, 0, 0})));
-        double radius = j_obj.value("radius", 1.0);
-				if(j_obj.contains("texture")){
-					auto surface = make_shared<lambertian>(make_shared<image_texture>(texture.c_str()));
-        	geometry_base = make_shared<sphere>(center, radius, surface);
-				}
-				else{
-					geometry_base = make_shared<sphere>(center, radius, mat);
-				}
-      } 
-
-      // Cilindro
-      else if (type == "cylinder") {
-        point3 center = parse_color(j_obj.value("center", json::array({0, 0, 0})));
-        double radius = j_obj.value("radius", 1.0);
-        double height = j_obj.value("height", 2.0);
-				geometry_base = make_shared<cylinder>(center, radius, height, mat);
+  // Definiciones con nombre: se construyen una sola vez y los objetos "instance"
+  // las reutilizan con su propia transformacion. Una definicion puede ser un objeto
+  // o un grupo ("objects"), que lleva su propio BVH, y puede usar las anteriores.
+  std::map<std::string, shared_ptr<hittable>> definitions;
+  if (data.contains("definitions") && data["definitions"].is_array()) {
+    for (const auto& j_def : data["definitions"]) {
+      std::string name = j_def.value("name", "");
+      shared_ptr<hittable> geometry;
+
+      if (j_def.contains("objects") && j_def["objects"].is_array()) {
+        hittable_list group;
+        for (const auto& j_obj : j_def["objects"])
+          if (auto object = parse_object(j_obj, definitions)) group.add(object);
+
+        if (group.objects.size() > 1)
+          geometry = make_shared<linear_bvh>(group);
+        else if (!group.objects.empty())
+          geometry = group.objects[0];
+      } else {
+        geometry = parse_object(j_def, definitions);
       }
 
-      // Caja
-      else if (type == "box") {
-        point3 p0 = parse_color(j_obj.value("p0", json::array({-1, -1, -1})));
-        point3 p1 = parse_color(j_obj.value("p1", json::array({1, 1, 1})));
-				geometry_base = make_shared<box>(p0, p1, mat);
+      if (name.empty() || !geometry) {
+        std::cerr << "Error: Definicion sin nombre o sin geometria" << std::endl;
+        continue;
       }
-			else if (type == "xz_rect"){
-				double x0 = j_obj.value("x0", 1.0);
-				double x1 = j_obj.value("x1", 1.0);
-				double z0 = j_obj.value("z0", 1.0);
-				double z1 = j_obj.value("z1", 1.0);
-				double k = j_obj.value("k", 1.0);
-				geometry_base = make_shared<xz_rect>(x0,x1,z0,z1,k,mat);
-			}
-			else if (type == "xy_rect"){
-				double x0 = j_obj.value("x0", 1.0);
-				double x1 = j_obj.value("x1", 1.0);
-				double y0 = j_obj.value("y0", 1.0);
-				double y1 = j_obj.value("y1", 1.0);
-				double k = j_obj.value("k", 1.0);
-				geometry_base = make_shared<xy_rect>(x0,x1,y0,y1,k,mat);
-			}
-			else if (type == "yz_rect"){
-				double y0 = j_obj.value("y0", 1.0);
-				double y1 = j_obj.value("y1", 1.0);
-				double z0 = j_obj.value("z0", 1.0);
-				double z1 = j_obj.value("z1", 1.0);
-				double k = j_obj.value("k", 1.0);
-				geometry_base = make_shared<yz_rect>(y0,y1,z0,z1,k,mat);
-			}
-			if (geometry_base) {
-        if (j_obj.contains("transforms") && j_obj["transforms"].is_array()) {
-          
-          Matrix4 M = parse_transformations(j_obj["transforms"]);
-          
-          world.add(make_shared<affine_transform>(geometry_base, M));
-        } else {
-          world.add(geometry_base);
-        }
+      definitions[name] = geometry;
+    }
+  }
+
+  // Procesar objetos
+  size_t instances = 0;
+  if (data.contains("objects") && data["objects"].is_array()) {
+    for (const auto& j_obj : data["objects"]) {
+      if (auto object = parse_object(j_obj, definitions)) {
+        world.add(object);
+        if (j_obj.value("type", "") == "instance") instances++;
       }
     }
   }
+  if (!definitions.empty())
+    std::clog << "Instancias: " << instances << " de " << definitions.size() << " definiciones\n";
 
+  cam.scene_hash = scene_fingerprint(data);
   cam.render(world);
+  image_cache::report();
 }
 
 int main(){
 	std::cout << "Selecciona una escena:\n";
 	std::cout << "Escenas pre hechas:\n";
-	std::cout << "1: Prueba de primitivas\n2: Prueba de texturas\n3:Prueba de luces\n\n4: Escena desde un archivo\n";
+	std::cout << "1: Prueba de primitivas\n2: Prueba de texturas\n3:Prueba de luces\n\n4: Escena desde un archivo\n5: Benchmarks\n";
 	int scene = 1;
 	std::cin >> scene;
 	std::string escena;
@@ -423,7 +557,9 @@ int main(){
 			std::cout << "Ruta de escena, se asume que esta en la carpeta scenes: ";
 			std::cin >> escena;
 			leer_escena(escena);
+			break;
 		}
+		case 5: run_benchmarks(); break;
 		default: break;
 	}
 	
@@ -0,0 +1,93 @@
+#ifndef AABB_H
+#define AABB_H
+
+// Caja alineada a los ejes, se usa para descartar rayos rapido en el BVH
+class aabb {
+  public:
+    interval x, y, z;
+
+    aabb() {} // Por defecto la caja esta vacia
+
+    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {
+        pad_to_minimums();
+    }
+
+    aabb(const point3& a, const point3& b) {
+        // Los puntos son esquinas opuestas, no importa el orden
+        x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+        pad_to_minimums();
+    }
+
+    aabb(const aabb& box0, const aabb& box1) {
+        x = interval(box0.x, box1.x);
+        y = interval(box0.y, box1.y);
+        z = interval(box0.z, box1.z);
+    }
+
+    const interval& axis_interval(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    bool hit(const ray& r, interval ray_t) const {
+        const point3& ray_orig = r.origin();
+        const vec3&   ray_dir  = r.direction();
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axis_interval(axis);
+            const real adinv = 1.0 / ray_dir[axis];
+
+            auto t0 = (ax.min - ray_orig[axis]) * adinv;
+            auto t1 = (ax.max - ray_orig[axis]) * adinv;
+
+            if (t0 < t1) {
+                if (t0 > ray_t.min) ray_t.min = t0;
+                if (t1 < ray_t.max) ray_t.max = t1;
+            } else {
+                if (t1 > ray_t.min) ray_t.min = t1;
+                if (t0 < ray_t.max) ray_t.max = t0;
+            }
+
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+
+    int longest_axis() const {
+        if (x.size() > y.size())
+            return x.size() > z.size() ? 0 : 2;
+        else
+            return y.size() > z.size() ? 1 : 2;
+    }
+
+    point3 centroid() const {
+        return point3((x.min + x.max) / 2, (y.min + y.max) / 2, (z.min + z.max) / 2);
+    }
+
+    // Area de la superficie, es lo que usa la heuristica SAH para estimar el costo
+    real surface_area() const {
+        if (x.size() < 0 || y.size() < 0 || z.size() < 0) return 0;
+        return 2 * (x.size()*y.size() + y.size()*z.size() + z.size()*x.size());
+    }
+
+    static const aabb empty, universe;
+
+  private:
+
+    void pad_to_minimums() {
+        // Evitamos cajas de grosor cero (por ejemplo los rectangulos)
+        real delta = 0.0001;
+        if (x.size() < delta) x = x.expand(delta);
+        if (y.size() < delta) y = y.expand(delta);
+        if (z.size() < delta) z = z.expand(delta);
+    }
+};
+
+const aabb aabb::empty    = aabb(interval::empty,    interval::empty,    interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+
+#endif
@@ -4,40 +4,127 @@
 #include "hittable.h"
 #include "mat4.h"
 
+// Objeto transformado por una matriz afin. Guarda la transformacion y su inversa
+// en formato 3x4; las normales usan la transpuesta de la inversa sin guardarla aparte.
 class affine_transform : public hittable {
 public:
   shared_ptr<hittable> object;
-  Matrix4 transform_matrix;
-  Matrix4 inverse_matrix;
-  Matrix4 normal_matrix; 
+  Matrix3x4 transform_matrix;
+  Matrix3x4 inverse_matrix;
 
-  affine_transform(shared_ptr<hittable> obj, const Matrix4& m) : object(obj), transform_matrix(m) {
-    if (!Matrix4::inverse(transform_matrix, inverse_matrix)) {
-      std::cerr << "Error: Matriz singular." << std::endl;
+  // Calcula la inversa con la formula cerrada para matrices afines. Con una
+  // matriz singular el objeto no se dibuja (y se avisa) en vez de usar una inversa basura.
+  affine_transform(shared_ptr<hittable> obj, const Matrix4& m) : object(obj) {
+    Matrix4 inverse;
+    invertible = Matrix4::affine_inverse(m, inverse);
+    if (!invertible) {
+      std::cerr << "Error: Matriz singular, el objeto transformado se omite." << std::endl;
+      return;
     }
-    normal_matrix = inverse_matrix.transpose();
+    init(m, inverse);
+  }
+
+  // Con la inversa ya calculada (parse_transformations la obtiene al leer la escena)
+  affine_transform(shared_ptr<hittable> obj, const Matrix4& m, const Matrix4& m_inv) : object(obj) {
+    init(m, m_inv);
   }
 
   bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-    // Recuperamos la posicion
-    point3 origin_local = inverse_matrix.mult_point(r.origin());
-    vec3 dir_local = inverse_matrix.mult_vec(r.direction());
+    // La caja del mundo descarta el rayo antes de tocar las matrices.
+    // Intersección en espacio local, t es el mismo en los dos espacios
+    if (!invertible || !bbox.hit(r, ray_t) || !object->hit(to_local(r), ray_t, rec))
+      return false;
+    to_world(rec);
+    return true;
+  }
 
-    ray ray_local(origin_local, dir_local);
+  // La transformacion no cambia t, el rayo local usa la direccion sin normalizar.
+  // No ocupa nivel en path: el objeto anota su camino como si no estuviera transformado.
+  bool hit_distance(const ray& r, interval ray_t, real& t, hit_path& path) const override {
+    return invertible && bbox.hit(r, ray_t) && object->hit_distance(to_local(r), ray_t, t, path);
+  }
 
-    // Intersección en espacio local
-    if (!object->hit(ray_local, ray_t, rec))
+  // Sigue el camino dentro del objeto (el primitivo ganador de una instancia) en vez de buscarlo otra vez
+  bool hit_winner(const ray& r, interval ray_t, const hit_path& path, int level, hit_record& rec) const override {
+    if (!object->hit_winner(to_local(r), ray_t, path, level, rec))
       return false;
+    to_world(rec);
+    return true;
+  }
+
+  bool occluded(const ray& r, interval ray_t) const override {
+    return invertible && bbox.hit(r, ray_t) && object->occluded(to_local(r), ray_t);
+  }
+
+  aabb bounding_box() const override { return bbox; }
 
+private:
+  aabb bbox;
+  bool invertible = true;
+  real uv_scale = 1;  // Distancia local por unidad de distancia del mundo, en promedio
+
+  ray to_local(const ray& r) const {
+    return ray(inverse_matrix.mult_point(r.origin()), inverse_matrix.mult_vec(r.direction()));
+  }
+
+  // Pasa al mundo el punto y la normal de un golpe calculado en espacio local
+  void to_world(hit_record& rec) const {
     // Aplicamos la transformacion a los puntos
     rec.p = transform_matrix.mult_point(rec.p);
 
-    // Transformación correcta de normales
-    vec3 normal_world = normal_matrix.mult_vec(rec.normal);
-    rec.set_face_normal(r, unit_vector(normal_world));
+    // Transformación correcta de normales: la transpuesta de la inversa. La normal
+    // local ya apunta contra el rayo local y la transformada sigue apuntando contra
+    // el rayo del mundo, asi que front_face se conserva.
+    vec3 normal_world = inverse_matrix.mult_transpose_vec(rec.normal);
+    rec.normal = normal_world * (1 / std::sqrt(normal_world.length_squared()));
+    rec.uv_density *= uv_scale;
+  }
 
-    return true;
+  void init(const Matrix4& m, const Matrix4& m_inv) {
+    // Transformaciones anidadas (por ejemplo una instancia de una definicion que ya
+    // estaba transformada) se juntan en una sola matriz, y sus inversas igual
+    Matrix4 total = m;
+    Matrix4 inverse = m_inv;
+    while (auto inner = dynamic_cast<const affine_transform*>(object.get())) {
+      if (!inner->invertible) {
+        invertible = false;
+        return;
+      }
+      total = total * inner->transform_matrix.to_matrix4();
+      inverse = inner->inverse_matrix.to_matrix4() * inverse;
+      object = inner->object;
+    }
+
+    transform_matrix = Matrix3x4(total);
+    inverse_matrix = Matrix3x4(inverse);
+
+    // La inversa cambia los volumenes por |det|, las longitudes por su raiz cubica
+    const real (&a)[4][4] = inverse.m;
+    vec3 row0(a[0][0], a[0][1], a[0][2]);
+    vec3 row1(a[1][0], a[1][1], a[1][2]);
+    vec3 row2(a[2][0], a[2][1], a[2][2]);
+    uv_scale = std::cbrt(std::fabs(dot(row0, cross(row1, row2))));
+
+    // Caja en espacio del mundo: transformamos las 8 esquinas de la caja local
+    aabb local = object->bounding_box();
+    point3 lo( infinity,  infinity,  infinity);
+    point3 hi(-infinity, -infinity, -infinity);
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 2; j++) {
+        for (int k = 0; k < 2; k++) {
+          point3 corner(i ? local.x.max : local.x.min,
+                        j ? local.y.max : local.y.min,
+                        k ? local.z.max : local.z.min);
+          point3 p = transform_matrix.mult_point(corner);
+          for (int c = 0; c < 3; c++) {
+            lo[c] = std::fmin(lo[c], p[c]);
+            hi[c] = std::fmax(hi[c], p[c]);
+          }
+        }
+      }
+    }
+    bbox = aabb(lo, hi);
   }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,81 @@
+// Herramienta: convierte una imagen (jpg, png...) al formato .rtt de baked_texture.h,
+// ya pasada a bytes y con todos sus mipmaps, para que el trazador la mapee al cargar
+// la escena sin decodificar nada.
+//
+// Uso: bake_texture entrada.jpg [salida.rtt]
+// La entrada se busca igual que las texturas de las escenas (tambien en images/).
+// Sin salida se usa el mismo nombre con extension .rtt junto a la imagen encontrada.
+
+#include "rtw_stb_image.h"
+
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Uso: bake_texture entrada.jpg [salida.rtt]\n";
+        return 1;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::string input = rtw_image::resolve(argv[1]);
+    if (input.empty()) {
+        std::cerr << "Error: No se encontro la imagen " << argv[1] << std::endl;
+        return 1;
+    }
+    std::string output = (argc > 2) ? argv[2] : input.substr(0, input.find_last_of('.')) + ".rtt";
+
+    rtw_image image;
+    if (!image.load(input)) {
+        std::cerr << "Error: No se pudo leer la imagen " << input << std::endl;
+        return 1;
+    }
+    image.build_mipmaps();
+
+    baked_texture::header h = {};
+    std::memcpy(h.magic, baked_texture::magic, 4);
+    h.version = baked_texture::version;
+    h.channels = baked_texture::channels;
+    h.levels = std::min(uint32_t(image.levels()), baked_texture::max_levels);
+
+    uint64_t offset = baked_texture::page_size;
+    for (uint32_t level = 0; level < h.levels; level++) {
+        h.level[level] = { offset, uint32_t(image.width(int(level))), uint32_t(image.height(int(level))) };
+        offset = baked_texture::align_to_page(offset + uint64_t(image.width(int(level))) * image.height(int(level)) * baked_texture::channels);
+    }
+
+    std::ofstream file(output, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: No se pudo escribir " << output << std::endl;
+        return 1;
+    }
+
+    // Encabezado y cada nivel rellenados con ceros hasta el limite de pagina
+    std::vector<char> padding(baked_texture::page_size, 0);
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    file.write(padding.data(), baked_texture::page_size - sizeof(h));
+    uint64_t written = baked_texture::page_size;
+
+    for (uint32_t level = 0; level < h.levels; level++) {
+        int w = image.width(int(level));
+        for (int y = 0; y < image.height(int(level)); y++)
+            file.write(reinterpret_cast<const char*>(image.pixel_data(int(level), 0, y)), std::streamsize(w) * baked_texture::channels);
+        written += uint64_t(w) * image.height(int(level)) * baked_texture::channels;
+
+        uint64_t aligned = baked_texture::align_to_page(written);
+        file.write(padding.data(), std::streamsize(aligned - written));
+        written = aligned;
+    }
+
+    if (!file) {
+        std::cerr << "Error: Fallo la escritura de " << output << std::endl;
+        return 1;
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+    std::clog << output << ": " << image.width() << "x" << image.height() << ", " << h.levels << " niveles, "
+              << written / (1024.0 * 1024.0) << " MB, " << elapsed.count() << " ms\n";
+    return 0;
+}
@@ -0,0 +1,221 @@
+#ifndef BAKED_TEXTURE_H
+#define BAKED_TEXTURE_H
+
+#include "tile_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Formato de textura pre-horneada (.rtt): los pixeles ya convertidos a bytes RGB,
+// fila por fila, con toda la cadena de mipmaps. Cada nivel empieza en un limite de
+// pagina, asi rtw_image mapea el archivo y usa los niveles directo, sin decodificar
+// (o los lee por bloques con baked_stream si hay tope de memoria).
+// Los enteros se guardan en little-endian, como los escribe x86.
+//
+//   [encabezado: baked_texture::header, ocupa la primera pagina]
+//   [nivel 0][relleno hasta la pagina][nivel 1][relleno]...
+namespace baked_texture {
+
+const char     magic[4]    = { 'R', 'T', 'T', 'X' };
+const uint32_t version     = 1;
+const uint32_t page_size   = 4096;
+const uint32_t max_levels  = 32;
+const uint32_t channels    = 3;
+
+struct level_entry {
+    uint64_t offset;  // Desde el inicio del archivo, multiplo de page_size
+    uint32_t width;
+    uint32_t height;
+};
+
+struct header {
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    channels;
+    uint32_t    levels;
+    level_entry level[max_levels];
+};
+
+static_assert(sizeof(header) <= page_size, "el encabezado debe caber en una pagina");
+
+inline uint64_t align_to_page(uint64_t offset) {
+    return (offset + page_size - 1) / page_size * page_size;
+}
+
+// Firma, version y canales correctos y cada nivel dentro del archivo
+inline bool valid_header(const header& h, uint64_t file_size) {
+    if (std::memcmp(h.magic, magic, 4) != 0 || h.version != version || h.channels != channels
+        || h.levels < 1 || h.levels > max_levels)
+        return false;
+    for (uint32_t level = 0; level < h.levels; level++) {
+        const level_entry& e = h.level[level];
+        uint64_t bytes = uint64_t(e.width) * e.height * channels;
+        if (e.width == 0 || e.height == 0 || e.offset > file_size || bytes > file_size - e.offset)
+            return false;
+    }
+    return true;
+}
+
+// El archivo empieza con la firma del formato
+inline bool is_baked(const std::string& path) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buffer[4] = {0};
+    bool ok = std::fread(buffer, 1, 4, f) == 4 && std::memcmp(buffer, magic, 4) == 0;
+    std::fclose(f);
+    return ok;
+}
+
+}  // namespace baked_texture
+
+// Archivo mapeado a memoria de solo lectura. Las paginas se leen del disco (o del
+// cache del sistema) la primera vez que se tocan.
+class mapped_file {
+  public:
+    mapped_file() {}
+    ~mapped_file() { close(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) return false;
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+            return false;
+        }
+        bytes = static_cast<const unsigned char*>(view);
+        length = size_t(file_size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // El mapeo sigue valido sin el descriptor
+        if (view == MAP_FAILED) return false;
+        bytes = static_cast<const unsigned char*>(view);
+        length = size_t(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+        if (bytes == nullptr) return;
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+        CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Archivo .rtt leido por bloques de tile_cache::tile_size a traves de tile_cache, en
+// vez de mapearlo entero: cada bloque se lee la primera vez que se muestrea y otra vez
+// si el cache lo descarto. Es lo que se usa cuando hay tope de memoria para texturas.
+class baked_stream {
+  public:
+    bool open(const std::string& path) {
+        file.rdbuf()->pubsetbuf(nullptr, 0);  // Sin buffer: cada fila es una sola lectura del tamano justo
+        file.open(path, std::ios::binary);
+        if (!file) return false;
+        file.seekg(0, std::ios::end);
+        uint64_t size = uint64_t(file.tellg());
+        file.seekg(0);
+        if (size < sizeof(h) || !file.read(reinterpret_cast<char*>(&h), sizeof(h)))
+            return false;
+        return baked_texture::valid_header(h, size);
+    }
+
+    int levels() const { return int(h.levels); }
+    int width(int level)  const { return int(h.level[level].width); }
+    int height(int level) const { return int(h.level[level].height); }
+
+    // x e y ya recortados al tamano del nivel
+    const unsigned char* pixel_data(int level, int x, int y) const {
+        const int size = tile_cache::tile_size;
+        int tile_x = x / size, tile_y = y / size;
+        const tile_cache::tile& t = tile_cache::fetch(tile_cache::make_key(id, level, tile_x, tile_y),
+                                                      [&] { return read_tile(level, tile_x, tile_y); });
+        return t.pixels.data() + (size_t(y % size) * t.width + x % size) * baked_texture::channels;
+    }
+
+  private:
+    baked_texture::header h = {};
+    uint32_t id = tile_cache::new_image_id();
+    mutable std::ifstream file;
+    mutable std::mutex file_mutex;
+
+    // Los niveles van fila por fila en el archivo: una lectura por fila del bloque
+    std::shared_ptr<const tile_cache::tile> read_tile(int level, int tile_x, int tile_y) const {
+        const baked_texture::level_entry& e = h.level[level];
+        const int size = tile_cache::tile_size;
+        int x0 = tile_x * size, y0 = tile_y * size;
+        int rows = std::min(size, int(e.height) - y0);
+
+        auto t = std::make_shared<tile_cache::tile>();
+        t->width = std::min(size, int(e.width) - x0);
+        t->pixels.resize(size_t(t->width) * rows * baked_texture::channels);
+        size_t row_bytes = size_t(t->width) * baked_texture::channels;
+
+        std::lock_guard<std::mutex> lock(file_mutex);
+        for (int row = 0; row < rows; row++) {
+            file.seekg(std::streamoff(e.offset + (uint64_t(y0 + row) * e.width + x0) * baked_texture::channels));
+            file.read(reinterpret_cast<char*>(t->pixels.data() + row * row_bytes), std::streamsize(row_bytes));
+        }
+        // Si el archivo se acorto despues de abrirlo el bloque queda negro
+        file.clear();
+        return t;
+    }
+};
+
+#endif
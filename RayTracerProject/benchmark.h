@@ -0,0 +1,241 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "affine.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "rtw_stb_image.h"
+#include "sphere.h"
+#include "sphere_simd.h"
+
+#include <chrono>
+#include <vector>
+
+// Micro-benchmarks para medir las partes criticas por separado.
+// Se corren desde el menu principal (opcion 5).
+
+// Mide el tiempo desde start hasta ahora, en segundos
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Esfera por esfera con sphere::hit contra los paquetes de 4 de sphere_set
+void benchmark_sphere_intersection() {
+  const int sphere_count = 4096;
+  const int ray_count = 4000;
+
+  seed_random(1, 0, 0);
+  auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+
+  std::vector<shared_ptr<sphere>> spheres;
+  std::vector<sphere_data> data;
+  for (int i = 0; i < sphere_count; i++) {
+    point3 center = vec3::random(-50, 50);
+    double radius = random_double(0.5, 2.0);
+    spheres.push_back(make_shared<sphere>(center, radius, mat));
+    data.push_back({center, radius, mat.get()});
+  }
+
+  sphere_set packets;
+  for (int i = 0; i < sphere_count; i += sphere_set::width)
+    packets.add_packet(&data[i], std::min(sphere_set::width, sphere_count - i));
+
+  std::vector<ray> rays;
+  for (int i = 0; i < ray_count; i++)
+    rays.push_back(ray(vec3::random(-60, 60), random_unit_vector()));
+
+  double tests = double(sphere_count) * ray_count;
+  hit_record rec;
+
+  auto start = std::chrono::steady_clock::now();
+  double scalar_sum = 0;
+  for (const auto& r : rays) {
+    double closest = infinity;
+    for (const auto& s : spheres)
+      if (s->sphere::hit(r, interval(0.001, closest), rec))
+        closest = rec.t;
+    if (closest < infinity) scalar_sum += closest;
+  }
+  double scalar_time = seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  double packet_sum = 0;
+  for (const auto& r : rays) {
+    double closest = infinity;
+    for (uint32_t p = 0; p < packets.size(); p++)
+      if (packets.hit(p, r, interval(0.001, closest), rec))
+        closest = rec.t;
+    if (closest < infinity) packet_sum += closest;
+  }
+  double packet_time = seconds_since(start);
+
+#if defined(__AVX__)
+  const char* isa = "AVX";
+#elif defined(RT_SPHERE_SSE2)
+  const char* isa = "SSE2";
+#else
+  const char* isa = "escalar";
+#endif
+
+  std::clog << "Interseccion rayo-esfera (" << sphere_count << " esferas x " << ray_count << " rayos)\n";
+  std::clog << "  sphere::hit        : " << tests / scalar_time / 1e6 << " M intersecciones/s\n";
+  std::clog << "  sphere_set (" << isa << ") : " << tests / packet_time / 1e6 << " M intersecciones/s"
+            << " (x" << scalar_time / packet_time << ")\n";
+  if (scalar_sum != packet_sum)
+    std::clog << "  AVISO: los resultados no coinciden (" << scalar_sum << " vs " << packet_sum << ")\n";
+}
+
+// Costo de los objetos transformados: Matrix4 contra Matrix3x4 por separado y
+// las mismas esferas directas o centradas en el origen dentro de un affine_transform
+void benchmark_affine_transform() {
+  const int sphere_count = 1024;
+  const int ray_count = 4000;
+  const int transform_count = 4000000;
+
+  seed_random(2, 0, 0);
+  auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+
+  Matrix4 M = Matrix4::translate(1, 2, 3) * Matrix4::rotate_y(30) * Matrix4::scale(2, 1, 0.5);
+  Matrix3x4 A(M);
+  std::vector<vec3> points;
+  for (int i = 0; i < 1024; i++)
+    points.push_back(vec3::random(-10, 10));
+
+  auto start = std::chrono::steady_clock::now();
+  vec3 sum4(0, 0, 0);
+  for (int i = 0; i < transform_count; i++) {
+    const vec3& p = points[i & 1023];
+    sum4 += M.mult_point(p) + M.mult_vec(p);
+  }
+  double mat4_time = seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  vec3 sum3(0, 0, 0);
+  for (int i = 0; i < transform_count; i++) {
+    const vec3& p = points[i & 1023];
+    sum3 += A.mult_point(p) + A.mult_vec(p);
+  }
+  double mat3x4_time = seconds_since(start);
+
+  hittable_list plain, transformed;
+  for (int i = 0; i < sphere_count; i++) {
+    point3 center = vec3::random(-50, 50);
+    double radius = random_double(0.5, 2.0);
+    plain.add(make_shared<sphere>(center, radius, mat));
+    transformed.add(make_shared<affine_transform>(make_shared<sphere>(point3(0, 0, 0), radius, mat),
+                                                  Matrix4::translate(center.x(), center.y(), center.z())));
+  }
+
+  std::vector<ray> rays;
+  for (int i = 0; i < ray_count; i++)
+    rays.push_back(ray(vec3::random(-60, 60), random_unit_vector()));
+
+  hit_record rec;
+  start = std::chrono::steady_clock::now();
+  double plain_sum = 0;
+  for (const auto& r : rays)
+    if (plain.hit(r, interval(0.001, infinity), rec)) plain_sum += rec.t;
+  double plain_time = seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  double transformed_sum = 0;
+  for (const auto& r : rays)
+    if (transformed.hit(r, interval(0.001, infinity), rec)) transformed_sum += rec.t;
+  double transformed_time = seconds_since(start);
+
+  double tests = double(sphere_count) * ray_count;
+  std::clog << "Transformaciones afines (" << transform_count << " puntos + vectores)\n";
+  std::clog << "  Matrix4            : " << transform_count / mat4_time / 1e6 << " M/s\n";
+  std::clog << "  Matrix3x4          : " << transform_count / mat3x4_time / 1e6 << " M/s"
+            << " (x" << mat4_time / mat3x4_time << ")\n";
+  std::clog << "Esferas con y sin affine_transform (" << sphere_count << " esferas x " << ray_count << " rayos)\n";
+  std::clog << "  sphere             : " << tests / plain_time / 1e6 << " M intersecciones/s\n";
+  std::clog << "  affine_transform   : " << tests / transformed_time / 1e6 << " M intersecciones/s"
+            << " (sobrecosto x" << transformed_time / plain_time << ")\n";
+  if ((sum4 - sum3).length() > 1e-6 * sum4.length())
+    std::clog << "  AVISO: Matrix4 y Matrix3x4 no coinciden\n";
+  if (std::fabs(plain_sum - transformed_sum) > 1e-6 * plain_sum)
+    std::clog << "  AVISO: los resultados no coinciden (" << plain_sum << " vs " << transformed_sum << ")\n";
+}
+
+// Lecturas de textura con la imagen fila por fila contra bloques de 4x4 (una linea de
+// cache), en varios tamanos. Cada consulta lee los 4 texels de una interpolacion bilineal.
+// "recorrido": consultas seguidas a un texel de distancia en direccion al azar, como los
+// golpes de pixeles vecinos sobre una superficie. "al azar": sin ninguna coherencia.
+void benchmark_texture_layout() {
+  const int walks = 100000;
+  const int steps = 32;
+
+  std::clog << "Lecturas de textura bilineales, fila por fila contra bloques de 4x4\n";
+  for (int size : {512, 2048, 8192}) {
+    int w = size, h = size / 2;
+    std::vector<unsigned char> rgb(size_t(w) * h * 3);
+    for (size_t i = 0; i < rgb.size(); i++)
+      rgb[i] = (unsigned char)((i * 2654435761u) >> 24);
+    rtw_image image(w, h, rgb.data());
+    rgb = std::vector<unsigned char>();
+
+    seed_random(3, 0, 0);
+    std::vector<vec3> starts, dirs;
+    for (int i = 0; i < walks; i++) {
+      starts.push_back(vec3(random_double(0, w), random_double(0, h), 0));
+      double angle = random_double(0, 2*pi);
+      dirs.push_back(vec3(std::cos(angle), std::sin(angle), 0));
+    }
+
+    auto bilinear = [&](int x, int y) {
+      return image.pixel_data(x, y)[0] + image.pixel_data(x + 1, y)[1]
+           + image.pixel_data(x, y + 1)[2] + image.pixel_data(x + 1, y + 1)[0];
+    };
+    auto run_walks = [&]() {
+      unsigned long sum = 0;
+      for (int i = 0; i < walks; i++) {
+        double x = starts[i].x(), y = starts[i].y();
+        for (int s = 0; s < steps; s++) {
+          sum += bilinear(int(x), int(y));
+          x += dirs[i].x();
+          y += dirs[i].y();
+        }
+      }
+      return sum;
+    };
+    auto run_random = [&]() {
+      unsigned long sum = 0;
+      for (int i = 0; i < walks; i++)
+        for (int s = 0; s < steps; s++)
+          sum += bilinear(int(starts[(i + s * 7919) % walks].x()), int(starts[(i * 31 + s) % walks].y()));
+      return sum;
+    };
+
+    double lookups = double(walks) * steps;
+    double times[2][2];
+    unsigned long sums[2][2];
+    for (int layout = 0; layout < 2; layout++) {
+      if (layout == 1) image.use_tiled_layout();
+      auto start = std::chrono::steady_clock::now();
+      sums[layout][0] = run_walks();
+      times[layout][0] = seconds_since(start);
+      start = std::chrono::steady_clock::now();
+      sums[layout][1] = run_random();
+      times[layout][1] = seconds_since(start);
+    }
+
+    const char* names[2] = { "recorrido", "al azar  " };
+    for (int pattern = 0; pattern < 2; pattern++) {
+      std::clog << "  " << w << "x" << h << " " << names[pattern] << ": fila por fila "
+                << lookups / times[0][pattern] / 1e6 << " M/s, bloques "
+                << lookups / times[1][pattern] / 1e6 << " M/s (x" << times[0][pattern] / times[1][pattern] << ")\n";
+      if (sums[0][pattern] != sums[1][pattern])
+        std::clog << "  AVISO: los resultados no coinciden\n";
+    }
+  }
+}
+
+void run_benchmarks() {
+  benchmark_sphere_intersection();
+  benchmark_affine_transform();
+  benchmark_texture_layout();
+}
+
+#endif
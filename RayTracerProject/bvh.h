@@ -0,0 +1,217 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <chrono>
+
+static const int sah_bins = 12;
+
+inline int sah_bin_index(double value, const interval& extent) {
+    int b = int(sah_bins * (value - extent.min) / extent.size());
+    return b < 0 ? 0 : (b >= sah_bins ? sah_bins - 1 : b);
+}
+
+// Elige el corte con la heuristica de area superficial (SAH): repartimos los
+// centroides en cubetas por eje y probamos cada frontera entre cubetas.
+// Reordena items[start, end) y devuelve el indice donde quedan partidos.
+// box_of(item) debe devolver la caja del elemento.
+template <typename T, typename BoxOf>
+size_t sah_partition(std::vector<T>& items, size_t start, size_t end, BoxOf box_of) {
+    aabb centroid_bounds;
+    for (size_t i = start; i < end; i++) {
+        point3 c = box_of(items[i]).centroid();
+        centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+    }
+
+    double best_cost = infinity;
+    int best_axis = -1;
+    int best_split = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const interval& extent = centroid_bounds.axis_interval(axis);
+        if (extent.size() <= 1e-12)
+            continue;
+
+        aabb bin_box[sah_bins];
+        int bin_count[sah_bins] = {0};
+        for (size_t i = start; i < end; i++) {
+            aabb box = box_of(items[i]);
+            int b = sah_bin_index(box.centroid()[axis], extent);
+            bin_count[b]++;
+            bin_box[b] = aabb(bin_box[b], box);
+        }
+
+        // Barrido desde la derecha para tener el area de cada sufijo
+        double right_area[sah_bins];
+        int right_count[sah_bins];
+        aabb acc;
+        int count = 0;
+        for (int b = sah_bins - 1; b > 0; b--) {
+            acc = aabb(acc, bin_box[b]);
+            count += bin_count[b];
+            right_area[b] = acc.surface_area();
+            right_count[b] = count;
+        }
+
+        acc = aabb();
+        count = 0;
+        for (int b = 0; b < sah_bins - 1; b++) {
+            acc = aabb(acc, bin_box[b]);
+            count += bin_count[b];
+            if (count == 0 || right_count[b+1] == 0)
+                continue;
+            double cost = acc.surface_area() * count + right_area[b+1] * right_count[b+1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    size_t mid = start + (end - start) / 2;
+
+    if (best_axis < 0) {
+        // Todos los centroides coinciden, cortamos por la mitad
+        return mid;
+    }
+
+    const interval& extent = centroid_bounds.axis_interval(best_axis);
+    auto it = std::partition(items.begin() + start, items.begin() + end,
+        [&](const T& item) {
+            return sah_bin_index(box_of(item).centroid()[best_axis], extent) <= best_split;
+        });
+
+    size_t split = size_t(it - items.begin());
+    if (split == start || split == end)
+        return mid;
+    return split;
+}
+
+// Jerarquia de volumenes envolventes (BVH). Cada nodo guarda la caja que
+// envuelve a sus dos hijos, asi un rayo que no toca la caja se salta todo el subarbol.
+class bvh_node : public hittable {
+  public:
+    bvh_node(hittable_list list) {
+        // Copiamos la lista porque la construccion reordena los objetos
+        auto start_time = std::chrono::steady_clock::now();
+        size_t node_count = 1;
+        build(list.objects, 0, list.objects.size(), node_count);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+
+        std::clog << "BVH: " << list.objects.size() << " objetos, " << node_count << " nodos, "
+                  << elapsed.count() << " ms\n";
+    }
+
+    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, size_t& node_count) {
+        build(objects, start, end, node_count);
+    }
+
+    // Se recorre el arbol solo con distancias y se completa el golpe del ganador
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_deferred(r, ray_t, rec);
+    }
+
+    // Los nodos internos no ocupan niveles de path: el de este nodo guarda la hoja ganadora
+    bool hit_distance(const ray& r, interval ray_t, real& t, hit_path& path) const override {
+        int level = path.depth;
+        int winner_depth = level;
+        const hittable* winner = closest(r, ray_t, t, path, level, winner_depth);
+
+        path.depth = level;
+        if (winner && level < hit_path::max_depth) {
+            path.steps[level].object = winner;
+            path.depth = winner_depth;
+        }
+        return winner != nullptr;
+    }
+
+    bool hit_winner(const ray& r, interval ray_t, const hit_path& path, int level, hit_record& rec) const override {
+        if (level >= path.depth)
+            return hit(r, ray_t, rec);
+        return path.steps[level].object->hit_winner(r, ray_t, path, level + 1, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (!bbox.hit(r, ray_t))
+            return false;
+        return left->occluded(r, ray_t) || (right != left && right->occluded(r, ray_t));
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    shared_ptr<hittable> left;
+    shared_ptr<hittable> right;
+    aabb bbox;
+    bool left_is_node = false;   // Para bajar sin dynamic_cast al recorrer
+    bool right_is_node = false;
+
+    // Hoja con el golpe mas cercano y su t. Las hojas anotan su camino en path a
+    // partir de level + 1; winner_depth es donde termina el de la ganadora.
+    const hittable* closest(const ray& r, interval ray_t, real& t, hit_path& path, int level, int& winner_depth) const {
+        if (!bbox.hit(r, ray_t))
+            return nullptr;
+
+        const hittable* winner = closest_in(left, left_is_node, r, ray_t, t, path, level, winner_depth);
+        if (winner)
+            ray_t.max = t;
+        if (const hittable* w = closest_in(right, right_is_node, r, ray_t, t, path, level, winner_depth))
+            winner = w;
+        return winner;
+    }
+
+    // t y winner_depth solo se escriben si hay golpe
+    static const hittable* closest_in(const shared_ptr<hittable>& child, bool is_node, const ray& r, interval ray_t,
+                                      real& t, hit_path& path, int level, int& winner_depth) {
+        if (is_node)
+            return static_cast<const bvh_node*>(child.get())->closest(r, ray_t, t, path, level, winner_depth);
+
+        real child_t;
+        path.depth = level + 1;
+        if (!child->hit_distance(r, ray_t, child_t, path))
+            return nullptr;
+        if (path.depth == level + 1)
+            path.leaf_max = ray_t.max;
+        winner_depth = path.depth;
+        t = child_t;
+        return child.get();
+    }
+
+    void build(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, size_t& node_count) {
+        bbox = aabb::empty;
+        for (size_t i = start; i < end; i++)
+            bbox = aabb(bbox, objects[i]->bounding_box());
+
+        size_t object_span = end - start;
+
+        if (object_span == 0) {
+            // Lista vacia, el hijo no se golpea nunca
+            left = right = make_shared<hittable_list>();
+            return;
+        }
+        if (object_span == 1) {
+            left = right = objects[start];
+            return;
+        }
+        if (object_span == 2) {
+            left = objects[start];
+            right = objects[start+1];
+            return;
+        }
+
+        size_t mid = sah_partition(objects, start, end,
+            [](const shared_ptr<hittable>& obj) { return obj->bounding_box(); });
+
+        node_count += 2;
+        left = make_shared<bvh_node>(objects, start, mid, node_count);
+        right = make_shared<bvh_node>(objects, mid, end, node_count);
+        left_is_node = right_is_node = true;
+    }
+};
+
+#endif
@@ -2,9 +2,19 @@
 #define CAMERA_H
 
 #include "hittable.h"
+#include "linear_bvh.h"
 #include "material.h"
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "thirdparty/stb_image_write.h"
 
@@ -14,6 +24,7 @@ class camera {
   int    image_width  = 100;  
   int    samples_per_pixel = 10;   
   int    max_depth         = 10;   
+  int    rr_depth          = 5;    // Rebotes antes de empezar la ruleta rusa
 	
   double vfov = 90; 
   color background; 
@@ -27,25 +38,84 @@ class camera {
   
   int cnt = 0;
 
+  int          tile_size   = 32;  // Lado en pixeles de cada bloque de trabajo
+  int          num_threads = 0;   // 0 = usar todos los nucleos disponibles
+  unsigned int seed        = 0;   // Semilla base, misma semilla = misma imagen
+  bool         wavefront   = false; // Trazar cada bloque por oleadas de rayos en vez de pixel por pixel
+
+  // Render progresivo: las muestras se acumulan por pasadas y cada cierto tiempo
+  // se escribe la imagen parcial y un punto de control para poder reanudar.
+  bool        progressive     = false;
+  int         pass_samples    = 4;     // Muestras por pixel en cada pasada
+  int         preview_passes  = 0;     // Escribir cada N pasadas (0 = no)
+  double      preview_seconds = 30;    // Escribir si pasaron estos segundos (0 = no)
+  std::string checkpoint_file = "render_checkpoint.bin";
+  bool        resume          = false; // Continuar desde checkpoint_file si existe
+  uint64_t    scene_hash      = 0;     // Huella de la escena y la camara, el punto de control solo se usa si coincide
+
+  // Muestreo adaptativo: cada pixel se muestrea por lotes hasta que el intervalo de
+  // confianza de su luminancia es pequeño; lo que se ahorra va a los pixeles ruidosos.
+  bool   adaptive             = false;
+  int    adaptive_min_samples = 16;    // Muestras antes de evaluar la convergencia
+  int    adaptive_batch       = 8;     // Muestras entre evaluaciones
+  double adaptive_threshold   = 0.05;  // Error relativo maximo (IC del 95%)
+  double adaptive_max_factor  = 4;     // Tope por pixel, en multiplos de samples_per_pixel
+
+  // Muestreo explicito de luces: en cada rebote difuso se elige un punto de una luz
+  // y se combina con el rebote del material por muestreo de importancia multiple (MIS).
+  // Las luces (esferas y rectangulos con diffuse_light) se buscan en la escena.
+  bool light_sampling = true;
+
+  // Estructura de aceleracion que se construye sobre la escena antes de renderizar
+  enum class accel_type { none, bvh, linear_bvh };
+  accel_type accel = accel_type::linear_bvh;
+
+  void render(const hittable_list& world) {
+    lights.clear();
+    if (light_sampling) {
+      collect_lights(world, lights);
+      std::clog << "Luces para muestreo explicito: " << lights.objects.size() << "\n";
+    }
+
+    if (accel == accel_type::bvh && world.objects.size() > 1) {
+      bvh_node bvh(world);
+      render(static_cast<const hittable&>(bvh));
+    } else if (accel == accel_type::linear_bvh && world.objects.size() > 1) {
+      linear_bvh bvh(world);
+      render(static_cast<const hittable&>(bvh));
+    } else {
+      render(static_cast<const hittable&>(world));
+    }
+  }
+
   void render(const hittable& world) {
-      initialize();
+    initialize();
 
-      std::vector<unsigned char> image_data(image_width * image_height * 3);
+    if (progressive && adaptive)
+      std::cerr << "Aviso: progressive y adaptive no se combinan, se usa progressive" << std::endl;
+    else if (adaptive && wavefront)
+      std::cerr << "Aviso: el muestreo adaptativo traza pixel por pixel, wavefront se ignora" << std::endl;
 
-    for (int j = 0; j < image_height; j++) {
-      if(double(j*100/(image_height-1)) >= cnt){
-        std::clog << "\rImagen generada: "<< cnt << '%' << ' ' << std::flush; 
-        cnt += 10;
-      }
-      for (int i = 0; i < image_width; i++) {
-                color pixel_color(0,0,0);
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                store_color_in_buffer(image_data, i, j, pixel_samples_scale * pixel_color);
-      }
+    if (progressive) {
+      render_progressive(world);
+      return;
+    }
+    if (adaptive) {
+      render_adaptive(world);
+      return;
     }
+
+    std::vector<unsigned char> image_data(image_width * image_height * 3);
+
+    for_each_tile([&](int x0, int y0) {
+      std::vector<color> sums;
+      trace_tile(world, x0, y0, 0, samples_per_pixel, sums);
+
+      int tile_w = std::min(x0 + tile_size, image_width) - x0;
+      for (int k = 0; k < int(sums.size()); k++)
+        store_color_in_buffer(image_data, x0 + k % tile_w, y0 + k / tile_w, pixel_samples_scale * sums[k]);
+    }, true);
+
     stbi_write_jpg("render_salida.jpg", image_width, image_height, 3, image_data.data(), 100);
     std::clog << "\rDone.                 \n";
   }
@@ -57,9 +127,11 @@ class camera {
     point3 pixel00_loc;    
     vec3   pixel_delta_u;  
     vec3   pixel_delta_v;  
+    double pixel_spread;   // Angulo que abarca un pixel, para el filtrado de texturas
     vec3   u, v, w;              
     vec3   defocus_disk_u;       
     vec3   defocus_disk_v;       
+    hittable_list lights;        // Luces que se muestrean en cada rebote
     
     void initialize() {
       image_height = int(image_width / aspect_ratio);
@@ -84,12 +156,487 @@ class camera {
 
       auto viewport_upper_left = center - (focus_dist * w) - viewport_u/2 - viewport_v/2;
       pixel00_loc = viewport_upper_left + 0.5 * (pixel_delta_u + pixel_delta_v);
+      pixel_spread = pixel_delta_u.length() / focus_dist;
       
       auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
       defocus_disk_u = u * defocus_radius;
       defocus_disk_v = v * defocus_radius;
     }
 
+    void render_progressive(const hittable& world) {
+      std::vector<color> accum(size_t(image_width) * image_height);
+      int samples_done = 0;
+
+      if (resume && load_checkpoint(accum, samples_done))
+        std::clog << "Reanudando desde " << checkpoint_file << " con " << samples_done << " muestras por pixel\n";
+
+      auto last_flush = std::chrono::steady_clock::now();
+      int pass = 0;
+
+      while (samples_done < samples_per_pixel) {
+        int s0 = samples_done;
+        int s1 = std::min(samples_done + std::max(pass_samples, 1), samples_per_pixel);
+
+        for_each_tile([&](int x0, int y0) {
+          // Las muestras nuevas se suman sobre lo acumulado en el mismo orden que en el
+          // render de una pasada, asi la imagen final sale identica
+          int x1 = std::min(x0 + tile_size, image_width);
+          int y1 = std::min(y0 + tile_size, image_height);
+          std::vector<color> sums;
+          for (int j = y0; j < y1; j++)
+            for (int i = x0; i < x1; i++)
+              sums.push_back(accum[size_t(j) * image_width + i]);
+
+          trace_tile(world, x0, y0, s0, s1, sums);
+
+          int k = 0;
+          for (int j = y0; j < y1; j++)
+            for (int i = x0; i < x1; i++)
+              accum[size_t(j) * image_width + i] = sums[k++];
+        }, false);
+
+        samples_done = s1;
+        pass++;
+        std::clog << "\rPasada " << pass << ": " << samples_done << "/" << samples_per_pixel
+                  << " muestras por pixel " << std::flush;
+
+        auto now = std::chrono::steady_clock::now();
+        double since_flush = std::chrono::duration<double>(now - last_flush).count();
+        bool flush = (preview_passes > 0 && pass % preview_passes == 0)
+                  || (preview_seconds > 0 && since_flush >= preview_seconds);
+
+        if (flush && samples_done < samples_per_pixel) {
+          write_accumulated(accum, samples_done);
+          save_checkpoint(accum, samples_done);
+          last_flush = now;
+        }
+      }
+
+      write_accumulated(accum, samples_done);
+      std::remove(checkpoint_file.c_str());
+      std::clog << "\rDone.                                   \n";
+    }
+
+    // Agrega a lights las primitivas emisoras que saben muestrearse. Solo se miran los
+    // objetos de la escena (y las listas y cajas entre ellos): las luces dentro de una
+    // instancia o una transformacion, y las mallas, no implementan pdf_value ni random
+    // en espacio del mundo, asi que solo las encuentra el rebote del material.
+    static void collect_lights(const hittable_list& list, hittable_list& lights) {
+      auto is_light = [](const material* mat) {
+        return mat && mat->kind() == material_kind::diffuse_light;
+      };
+
+      for (const auto& object : list.objects) {
+        const hittable* obj = object.get();
+        if (auto s = dynamic_cast<const sphere*>(obj)) {
+          if (is_light(s->get_material().get())) lights.add(object);
+        } else if (auto q = dynamic_cast<const xy_rect*>(obj)) {
+          if (is_light(q->mat.get())) lights.add(object);
+        } else if (auto q = dynamic_cast<const xz_rect*>(obj)) {
+          if (is_light(q->mat.get())) lights.add(object);
+        } else if (auto q = dynamic_cast<const yz_rect*>(obj)) {
+          if (is_light(q->mat.get())) lights.add(object);
+        } else if (auto b = dynamic_cast<const box*>(obj)) {
+          if (is_light(b->mat.get())) collect_lights(b->faces(), lights);
+        } else if (auto l = dynamic_cast<const hittable_list*>(obj)) {
+          collect_lights(*l, lights);
+        }
+      }
+    }
+
+    // Ancho en uv del pixel proyectado en el golpe: el cono del pixel se abre
+    // pixel_spread por unidad de distancia recorrida (sumando los rebotes). Se usa
+    // la mitad porque la interpolacion bilineal del nivel elegido ya promedia unos
+    // 2 texels; estirarlo con la inclinacion borroneaba de mas los bordes.
+    void set_uv_footprint(hit_record& rec, double path_length) const {
+      rec.uv_footprint = 0.5 * rec.uv_density * pixel_spread * path_length;
+    }
+
+    // Heuristica de potencia (beta = 2) de Veach para pesar dos estrategias
+    static double power_heuristic(double pdf_a, double pdf_b) {
+      double a2 = pdf_a * pdf_a;
+      double b2 = pdf_b * pdf_b;
+      return a2 / (a2 + b2);
+    }
+
+    // Estadisticas por pixel del modo adaptativo: suma de color y media/varianza
+    // de la luminancia con el algoritmo de Welford
+    struct pixel_stats {
+      color  sum;
+      double mean = 0;
+      double m2 = 0;
+      int    n = 0;
+      bool   converged = false;
+    };
+
+    void render_adaptive(const hittable& world) {
+      // Con lotes o minimos menores a 1 un pixel sin converger no avanzaria nunca
+      adaptive_batch = std::max(adaptive_batch, 1);
+      adaptive_min_samples = std::max(adaptive_min_samples, 1);
+
+      std::vector<pixel_stats> stats(size_t(image_width) * image_height);
+
+      // Primera fase: cada pixel hasta converger o llegar a samples_per_pixel
+      for_each_tile([&](int x0, int y0) {
+        sample_tile_adaptive(world, x0, y0, stats, samples_per_pixel);
+      }, true);
+
+      long long fixed_total = (long long)samples_per_pixel * image_width * image_height;
+      long long used = 0;
+      long long noisy = 0;
+      for (const auto& px : stats) {
+        used += px.n;
+        if (!px.converged) noisy++;
+      }
+
+      // Segunda fase: el presupuesto ahorrado se reparte entre los pixeles sin converger
+      long long extra_total = 0;
+      if (noisy > 0 && used < fixed_total) {
+        int cap = int(samples_per_pixel * adaptive_max_factor);
+        int max_n = int(std::min<long long>(samples_per_pixel + (fixed_total - used) / noisy, cap));
+        if (max_n > samples_per_pixel) {
+          for_each_tile([&](int x0, int y0) {
+            sample_tile_adaptive(world, x0, y0, stats, max_n);
+          }, false);
+
+          long long total = 0;
+          for (const auto& px : stats) total += px.n;
+          extra_total = total - used;
+        }
+      }
+
+      std::vector<unsigned char> image_data(image_width * image_height * 3);
+      for (int j = 0; j < image_height; j++)
+        for (int i = 0; i < image_width; i++) {
+          const pixel_stats& px = stats[size_t(j) * image_width + i];
+          store_color_in_buffer(image_data, i, j, px.sum / px.n);
+        }
+      stbi_write_jpg("render_salida.jpg", image_width, image_height, 3, image_data.data(), 100);
+
+      std::clog << "\rDone.                 \n";
+      std::clog << "Muestreo adaptativo: " << used + extra_total << " muestras (fijo: " << fixed_total << "), "
+                << 100.0 * (fixed_total - used) / fixed_total << "% ahorrado en la primera fase, "
+                << extra_total << " muestras extra para " << noisy << " pixeles ruidosos\n";
+    }
+
+    void sample_tile_adaptive(const hittable& world, int x0, int y0, std::vector<pixel_stats>& stats, int max_n) const {
+      int x1 = std::min(x0 + tile_size, image_width);
+      int y1 = std::min(y0 + tile_size, image_height);
+
+      for (int j = y0; j < y1; j++) {
+        for (int i = x0; i < x1; i++) {
+          pixel_stats& px = stats[size_t(j) * image_width + i];
+
+          while (px.n < max_n && !px.converged) {
+            int batch_end = std::min(std::max(px.n + adaptive_batch, adaptive_min_samples), max_n);
+            for (; px.n < batch_end; ) {
+              seed_random(seed, uint64_t(j) * image_width + i, px.n);
+              color c = ray_color(get_ray(i, j), world);
+              px.sum += c;
+
+              double y = luminance(c);
+              px.n++;
+              double delta = y - px.mean;
+              px.mean += delta / px.n;
+              px.m2 += delta * (y - px.mean);
+            }
+
+            if (px.n >= adaptive_min_samples && px.n > 1) {
+              double error = 1.96 * std::sqrt(px.m2 / (px.n - 1) / px.n);
+              px.converged = error <= adaptive_threshold * std::max(px.mean, 0.05);
+            }
+          }
+        }
+      }
+    }
+
+    // Escribe la imagen con el promedio de las muestras acumuladas hasta ahora
+    void write_accumulated(const std::vector<color>& accum, int samples_done) {
+      std::vector<unsigned char> image_data(image_width * image_height * 3);
+      double scale = 1.0 / samples_done;
+
+      for (int j = 0; j < image_height; j++)
+        for (int i = 0; i < image_width; i++)
+          store_color_in_buffer(image_data, i, j, scale * accum[size_t(j) * image_width + i]);
+      stbi_write_jpg("render_salida.jpg", image_width, image_height, 3, image_data.data(), 100);
+    }
+
+    // Formato del punto de control: este encabezado y luego las sumas RGB de cada pixel
+    // en real (float o double segun la compilacion, ver real_size)
+    struct checkpoint_header {
+      char     magic[4];           // "RTCK"
+      uint32_t version;
+      uint32_t real_size;          // sizeof(real)
+      int32_t  width;
+      int32_t  height;
+      uint32_t seed;
+      int32_t  samples_per_pixel;
+      int32_t  samples_done;
+      uint64_t scene_hash;         // Ver camera::scene_hash
+    };
+
+    static const uint32_t checkpoint_version = 2;
+    static_assert(sizeof(color) == 3 * sizeof(real), "color se guarda tal cual en el punto de control");
+
+    void save_checkpoint(const std::vector<color>& accum, int samples_done) const {
+      checkpoint_header header = { {'R','T','C','K'}, checkpoint_version, uint32_t(sizeof(real)), image_width,
+                                   image_height, seed, samples_per_pixel, samples_done, scene_hash };
+
+      // Escribimos a un temporal y luego renombramos, asi un corte a medias no
+      // deja un punto de control roto
+      std::string tmp = checkpoint_file + ".tmp";
+      {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out) {
+          std::cerr << "Error: no se pudo escribir el punto de control " << tmp << std::endl;
+          return;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(accum.data()), accum.size() * sizeof(color));
+      }
+
+      // En POSIX rename reemplaza el destino de forma atomica. En Windows falla si el
+      // destino existe; solo ahi se borra primero y queda un instante sin punto de control.
+      if (std::rename(tmp.c_str(), checkpoint_file.c_str()) != 0) {
+        std::remove(checkpoint_file.c_str());
+        std::rename(tmp.c_str(), checkpoint_file.c_str());
+      }
+    }
+
+    bool load_checkpoint(std::vector<color>& accum, int& samples_done) const {
+      std::ifstream in(checkpoint_file, std::ios::binary);
+      if (!in)
+        return false;
+
+      checkpoint_header header;
+      in.read(reinterpret_cast<char*>(&header), sizeof(header));
+      if (!in || std::string(header.magic, 4) != "RTCK" || header.version != checkpoint_version
+          || header.real_size != sizeof(real) || header.width != image_width || header.height != image_height
+          || header.seed != seed || header.samples_per_pixel != samples_per_pixel || header.scene_hash != scene_hash) {
+        std::cerr << "Aviso: " << checkpoint_file << " no corresponde a esta escena, se ignora" << std::endl;
+        return false;
+      }
+      if (header.samples_done <= 0 || header.samples_done > samples_per_pixel) {
+        std::cerr << "Aviso: " << checkpoint_file << " tiene un numero de muestras invalido, se ignora" << std::endl;
+        return false;
+      }
+
+      in.read(reinterpret_cast<char*>(accum.data()), accum.size() * sizeof(color));
+      if (!in) {
+        std::cerr << "Aviso: " << checkpoint_file << " esta incompleto, se ignora" << std::endl;
+        std::fill(accum.begin(), accum.end(), color(0,0,0));
+        return false;
+      }
+
+      samples_done = header.samples_done;
+      return true;
+    }
+
+    // Reparte los bloques de la imagen entre un grupo de hilos. Cada hilo toma el
+    // siguiente bloque libre y llama a work(x0, y0); los bloques no se enciman, asi
+    // que cada hilo escribe solo sus pixeles y no hace falta bloquear el buffer.
+    void for_each_tile(const std::function<void(int, int)>& work, bool show_progress) {
+      int tiles_x = (image_width + tile_size - 1) / tile_size;
+      int tiles_y = (image_height + tile_size - 1) / tile_size;
+      int total_tiles = tiles_x * tiles_y;
+
+      std::atomic<int> next_tile{0};
+      std::atomic<int> done_tiles{0};
+      std::mutex progress_mutex;
+
+      auto worker = [&]() {
+        for (int tile = next_tile++; tile < total_tiles; tile = next_tile++) {
+          work((tile % tiles_x) * tile_size, (tile / tiles_x) * tile_size);
+
+          if (!show_progress) continue;
+          int done = ++done_tiles;
+          std::lock_guard<std::mutex> lock(progress_mutex);
+          while (done * 100 / total_tiles >= cnt && cnt <= 100) {
+            std::clog << "\rImagen generada: "<< cnt << '%' << ' ' << std::flush;
+            cnt += 10;
+          }
+        }
+      };
+
+      int n = num_threads > 0 ? num_threads : int(std::thread::hardware_concurrency());
+      if (n < 1) n = 1;
+
+      std::vector<std::thread> pool;
+      for (int t = 1; t < n; t++)
+        pool.emplace_back(worker);
+      worker();
+      for (auto& th : pool)
+        th.join();
+    }
+
+    // Suma las muestras [s0, s1) de cada pixel del bloque que empieza en (x0, y0).
+    // sums queda fila por fila dentro del bloque; si ya trae un valor por pixel las
+    // muestras se suman a el, si viene vacio empieza en cero.
+    void trace_tile(const hittable& world, int x0, int y0, int s0, int s1, std::vector<color>& sums) const {
+      if (wavefront)
+        trace_tile_wavefront(world, x0, y0, s0, s1, sums);
+      else
+        trace_tile_pixels(world, x0, y0, s0, s1, sums);
+    }
+
+    void trace_tile_pixels(const hittable& world, int x0, int y0, int s0, int s1, std::vector<color>& sums) const {
+      int x1 = std::min(x0 + tile_size, image_width);
+      int y1 = std::min(y0 + tile_size, image_height);
+      sums.resize((x1 - x0) * (y1 - y0), color(0,0,0));
+
+      int k = 0;
+      for (int j = y0; j < y1; j++) {
+        for (int i = x0; i < x1; i++, k++) {
+          for (int sample = s0; sample < s1; sample++) {
+            seed_random(seed, uint64_t(j) * image_width + i, sample);
+            ray r = get_ray(i, j);
+            sums[k] += ray_color(r, world);
+          }
+        }
+      }
+    }
+
+    // Estado de un camino en el modo wavefront
+    struct path_state {
+      ray   r;
+      color throughput;
+      color radiance;
+      int   pixel;  // Indice del pixel dentro del bloque
+      double path_length;  // Distancia recorrida desde la camara
+      double scatter_pdf;  // Densidad del rebote que trajo a r, 0 = sin MIS (como en ray_color)
+    };
+
+    // Modo wavefront: por cada muestra lanzamos un rayo por pixel del bloque y
+    // avanzamos todos los caminos un rebote a la vez. En cada rebote primero se
+    // intersecan todos juntos con world.hit_batch (el BVH lineal baja el arbol una
+    // vez para toda la oleada), luego los golpes se agrupan por clase de material y
+    // cada grupo se dispersa en un ciclo sin llamadas virtuales. Los rayos de sombra
+    // del muestreo de luces se trazan uno por uno al dispersar.
+    void trace_tile_wavefront(const hittable& world, int x0, int y0, int s0, int s1, std::vector<color>& sums) const {
+      int x1 = std::min(x0 + tile_size, image_width);
+      int y1 = std::min(y0 + tile_size, image_height);
+      int tile_w = x1 - x0;
+      int tile_pixels = tile_w * (y1 - y0);
+
+      sums.resize(tile_pixels, color(0,0,0));
+      std::vector<path_state> paths(tile_pixels);
+      std::vector<hit_record> hits(tile_pixels);
+      std::vector<ray> wave_rays(tile_pixels);
+      std::vector<hit_record> wave_hits(tile_pixels);
+      std::vector<unsigned char> did_hit(tile_pixels);
+      std::vector<int> active, surviving, by_kind;
+      active.reserve(tile_pixels);
+      surviving.reserve(tile_pixels);
+      by_kind.reserve(tile_pixels);
+
+      const int kinds = int(material_kind::count);
+      static_assert(kinds == 6, "falta el scatter_group de una clase de material");
+
+      for (int sample = s0; sample < s1; sample++) {
+        active.clear();
+        for (int k = 0; k < tile_pixels; k++) {
+          int i = x0 + k % tile_w;
+          int j = y0 + k / tile_w;
+          seed_random(seed, uint64_t(j) * image_width + i, sample);
+          paths[k] = { get_ray(i, j), color(1,1,1), color(0,0,0), k, 0, 0 };
+          active.push_back(k);
+        }
+
+        for (int bounce = 0; bounce < max_depth && !active.empty(); bounce++) {
+          // 1. Interseccion de toda la oleada
+          int wave = int(active.size());
+          for (int n = 0; n < wave; n++) {
+            wave_rays[n] = paths[active[n]].r;
+            wave_hits[n].uv_density = 0;  // El registro se reutiliza entre rebotes
+          }
+          world.hit_batch(wave_rays.data(), wave, interval(hit_epsilon, infinity), wave_hits.data(), did_hit.data());
+
+          surviving.clear();
+          for (int n = 0; n < wave; n++) {
+            int k = active[n];
+            path_state& path = paths[k];
+            if (!did_hit[n]) {
+              color ambient = (bounce == 0) ? get_sunset_background(path.r.direction()) : color(0.2,0.2,0.2);
+              path.radiance += path.throughput * ambient;
+              continue;
+            }
+            hits[k] = wave_hits[n];
+            path.path_length += hits[k].t * path.r.direction().length();
+            set_uv_footprint(hits[k], path.path_length);
+            const hit_record& rec = hits[k];
+            color emitted = rec.mat->emitted(path.r, rec, rec.u, rec.v, rec.p);
+            if (path.scatter_pdf > 0 && rec.mat->kind() == material_kind::diffuse_light)
+              emitted *= power_heuristic(path.scatter_pdf, light_pdf_at(path.r, rec));
+            path.radiance += path.throughput * emitted;
+            surviving.push_back(k);
+          }
+
+          // 2. Ordenamiento por cubetas segun la clase de material
+          int offsets[kinds + 1] = {0};
+          for (int k : surviving)
+            offsets[int(hits[k].mat->kind()) + 1]++;
+          for (int c = 0; c < kinds; c++)
+            offsets[c + 1] += offsets[c];
+          by_kind.resize(surviving.size());
+          int fill[kinds];
+          std::copy(offsets, offsets + kinds, fill);
+          for (int k : surviving)
+            by_kind[fill[int(hits[k].mat->kind())]++] = k;
+
+          // 3. Dispersion por grupos
+          active.clear();
+          scatter_group<material>(world, by_kind, offsets[0], offsets[1], paths, hits, bounce, active);
+          scatter_group<lambertian>(world, by_kind, offsets[1], offsets[2], paths, hits, bounce, active);
+          scatter_group<metal>(world, by_kind, offsets[2], offsets[3], paths, hits, bounce, active);
+          scatter_group<dielectric>(world, by_kind, offsets[3], offsets[4], paths, hits, bounce, active);
+          scatter_group<diffuse_light>(world, by_kind, offsets[4], offsets[5], paths, hits, bounce, active);
+          scatter_group<phong_material>(world, by_kind, offsets[5], offsets[6], paths, hits, bounce, active);
+        }
+
+        for (int k = 0; k < tile_pixels; k++)
+          sums[k] += paths[k].radiance;
+      }
+    }
+
+    // Dispersa los caminos by_kind[begin, end), todos con material de clase M. Con M
+    // concreto la llamada M::scatter no es virtual y el compilador la puede expandir.
+    // Antes de dispersar se muestrean las luces, igual que en ray_color.
+    template <typename M>
+    void scatter_group(const hittable& world, const std::vector<int>& by_kind, int begin, int end,
+                       std::vector<path_state>& paths, const std::vector<hit_record>& hits, int bounce,
+                       std::vector<int>& active) const {
+      for (int n = begin; n < end; n++) {
+        int k = by_kind[n];
+        path_state& path = paths[k];
+        const hit_record& rec = hits[k];
+        const M* mat = static_cast<const M*>(rec.mat);
+
+        scatter_sample s;
+        bool did_scatter;
+        if constexpr (std::is_same_v<M, material>)
+          did_scatter = mat->sample(path.r, rec, s);
+        else
+          did_scatter = mat->M::sample(path.r, rec, s);
+        if (!did_scatter)
+          continue;
+
+        path.scatter_pdf = (s.is_specular || lights.objects.empty()) ? 0 : s.pdf;
+        if (path.scatter_pdf > 0)
+          path.radiance += path.throughput * sample_lights(path.r, rec, world);
+
+        path.throughput = path.throughput * s.weight;
+        if (bounce + 1 >= rr_depth) {
+          double p = std::fmin(std::fmax(path.throughput.x(), std::fmax(path.throughput.y(), path.throughput.z())), 0.95);
+          if (random_double() >= p)
+            continue;
+          path.throughput /= p;
+        }
+
+        path.r = ray(rec.p, s.direction);
+        active.push_back(k);
+      }
+    }
+
     void store_color_in_buffer(std::vector<unsigned char>& data, int i, int j, const color& pixel_color) {
         auto r = pixel_color.x();
         auto g = pixel_color.y();
@@ -145,31 +692,100 @@ class camera {
       return (1.0 - t) * horizon_color + t * zenith_color;
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) const {
-      if(depth <= 0) return color(0,0,0);
+    // Trazado iterativo: en vez de recursion acumulamos la luz (radiance) y lo que
+    // queda de ella tras cada rebote (throughput). Pasado rr_depth aplicamos ruleta
+    // rusa: el camino sigue con probabilidad p y si sigue se divide entre p, asi el
+    // promedio no cambia pero los caminos oscuros terminan antes.
+    color ray_color(const ray& r_in, const hittable& world) const {
+      color radiance(0,0,0);
+      color throughput(1,1,1);
+      ray r = r_in;
+      double scatter_pdf = 0;  // Densidad del rebote que trajo a r, 0 = sin MIS
+      double path_length = 0;  // Distancia recorrida desde la camara
 
-      hit_record rec;
+      for (int bounce = 0; bounce < max_depth; bounce++) {
+        hit_record rec;
 
-      if(!world.hit(r, interval(0.001, infinity), rec)) {
-        
-        // Si es el rayo original de la cámara (depth == max_depth), mostramos el cielo.
-        if (depth == max_depth) {
-            return get_sunset_background(r.direction());
+        if(!world.hit(r, interval(hit_epsilon, infinity), rec)) {
+          // Si es el rayo original de la cámara mostramos el cielo, si no luz ambiente
+          color ambient = (bounce == 0) ? get_sunset_background(r.direction()) : color(0.2,0.2,0.2);
+          radiance += throughput * ambient;
+          break;
         }
-        // Luz ambiente
-        return color(0.2,0.2,0.2);
+
+        path_length += rec.t * r.direction().length();
+        set_uv_footprint(rec, path_length);
+
+        color emitted = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+
+        // Si el rebote anterior tambien muestreo luces, esta luz ya se conto alli en parte
+        if (scatter_pdf > 0 && rec.mat->kind() == material_kind::diffuse_light)
+          emitted *= power_heuristic(scatter_pdf, light_pdf_at(r, rec));
+        radiance += throughput * emitted;
+
+        scatter_sample s;
+        if(!rec.mat->sample(r, rec, s))
+          break;
+
+        scatter_pdf = (s.is_specular || lights.objects.empty()) ? 0 : s.pdf;
+        if (scatter_pdf > 0)
+          radiance += throughput * sample_lights(r, rec, world);
+
+        throughput = throughput * s.weight;
+
+        if (bounce + 1 >= rr_depth) {
+          double p = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 0.95);
+          if (random_double() >= p)
+            break;
+          throughput /= p;
+        }
+
+        r = ray(rec.p, s.direction);
       }
 
-      ray scattered;
-      color attenuation;
-      color color_from_emmision = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+      return radiance;
+    }
 
-      if(!rec.mat->scatter(r, rec, attenuation, scattered))
-        return color_from_emmision;
-        
-      color color_from_scatter = attenuation * ray_color(scattered, depth-1, world);
+    // Luz directa por un punto elegido en una luz y un rayo de sombra:
+    // eval del material * Le / pdf, con el peso MIS. Se interseca solo la luz elegida
+    // y el rayo de sombra solo pregunta si algo la tapa antes de llegar; por eso la pdf
+    // es la de esa luz (entre N por haberla elegido) y no la de la mezcla de todas.
+    color sample_lights(const ray& r_in, const hit_record& rec, const hittable& world) const {
+      size_t index = std::min(size_t(random_double() * lights.objects.size()), lights.objects.size() - 1);
+      const hittable& light = *lights.objects[index];
+      ray shadow(rec.p, light.random(rec.p));
+
+      double material_pdf = rec.mat->pdf(r_in, rec, shadow.direction());
+      if (material_pdf <= 0)
+        return color(0,0,0);
+
+      hit_record light_rec;
+      if (!light.hit(shadow, interval(hit_epsilon, infinity), light_rec))
+        return color(0,0,0);
+
+      double light_pdf = light.pdf_value(shadow.origin(), shadow.direction()) / lights.objects.size();
+      if (light_pdf <= 0)
+        return color(0,0,0);
 
-      return color_from_emmision + color_from_scatter;
+      if (world.occluded(shadow, interval(hit_epsilon, light_rec.t * (1 - hit_epsilon))))
+        return color(0,0,0);
+
+      color emitted = light_rec.mat->emitted(shadow, light_rec, light_rec.u, light_rec.v, light_rec.p);
+      color f = rec.mat->eval(r_in, rec, shadow.direction());
+      return f * emitted * (power_heuristic(light_pdf, material_pdf) / light_pdf);
+    }
+
+    // Densidad con que sample_lights habria llegado al golpe rec por la direccion de r:
+    // la de la luz golpeada entre N. 0 si lo golpeado no esta en lights (por ejemplo una
+    // malla emisora), porque entonces solo el rebote del material lo puede encontrar.
+    double light_pdf_at(const ray& r, const hit_record& rec) const {
+      for (const auto& light : lights.objects) {
+        hit_record light_rec;
+        if (light->hit(r, interval(hit_epsilon, infinity), light_rec)
+            && std::fabs(light_rec.t - rec.t) <= hit_epsilon * rec.t)
+          return light->pdf_value(r.origin(), r.direction()) / lights.objects.size();
+      }
+      return 0;
     }
 };
 
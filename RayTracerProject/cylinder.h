@@ -8,118 +8,146 @@
 class cylinder : public hittable {
 public:
   point3 center;
-  double radius;
-  double height;
+  real radius;
+  real height;
   shared_ptr<material> mat;
 
-  cylinder(const point3& c, double r, double h, shared_ptr<material> m)
+  cylinder(const point3& c, real r, real h, shared_ptr<material> m)
     : center(c), radius(r), height(h), mat(m) {}
 
   bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+    real t;
+    int face;
+    if (!closest_t(r, ray_t, t, face))
+      return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.u = rec.v = 0;
+    rec.uv_density = 0;
+
+    vec3 outward_normal = (face == 0)
+      ? unit_vector(vec3(rec.p.x() - center.x(), 0, rec.p.z() - center.z()))
+      : vec3(0, face, 0);
+
+    rec.set_face_normal(r, outward_normal);
+    rec.mat = mat.get();
+    return true;
+  }
 
-    bool hit_anything = false;
-    hit_record temp_rec;
-    double closest_t = ray_t.max;
+  bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const override {
+    int face;
+    return closest_t(r, ray_t, t, face);
+  }
 
+  // Mismas pruebas que hit() pero sale con el primer corte valido
+  bool occluded(const ray& r, interval ray_t) const override {
     vec3 oc = r.origin() - center;
-    double half_h = height / 2.0;
-
-    // Contorno
+    real half_h = height / 2.0;
 
-    double a = r.direction().x()*r.direction().x()
+    real a = r.direction().x()*r.direction().x()
              + r.direction().z()*r.direction().z();
-    double b = 2*(oc.x()*r.direction().x() + oc.z()*r.direction().z());
-    double c = oc.x()*oc.x() + oc.z()*oc.z() - radius*radius;
+    real b = 2*(oc.x()*r.direction().x() + oc.z()*r.direction().z());
+    real c = oc.x()*oc.x() + oc.z()*oc.z() - radius*radius;
 
-    double discriminant = b*b - 4*a*c;
+    real discriminant = b*b - 4*a*c;
 
     if (discriminant >= 0) {
-      double sqrtd = sqrt(discriminant);
+      real sqrtd = sqrt(discriminant);
+      real roots[2] = { (-b - sqrtd) / (2*a), (-b + sqrtd) / (2*a) };
+      for (real root : roots) {
+        real y = oc.y() + root * r.direction().y();
+        if (ray_t.surrounds(root) && y >= -half_h && y <= half_h)
+          return true;
+      }
+    }
 
-      double root = (-b - sqrtd) / (2*a);
-      if (!ray_t.surrounds(root))
-        root = (-b + sqrtd) / (2*a);
+    real denom = r.direction().y();
+    if (fabs(denom) > 1e-8) {
+      real caps[2] = { center.y() - half_h, center.y() + half_h };
+      for (real y_cap : caps) {
+        real t = (y_cap - r.origin().y()) / denom;
+        if (!ray_t.surrounds(t))
+          continue;
+
+        real dx = oc.x() + t * r.direction().x();
+        real dz = oc.z() + t * r.direction().z();
+        if (dx*dx + dz*dz <= radius*radius)
+          return true;
+      }
+    }
 
-      if (ray_t.surrounds(root)) {
-        double y = oc.y() + root * r.direction().y();
+    return false;
+  }
 
-        if (y >= -half_h && y <= half_h) {
-          if (root < closest_t) {
-            closest_t = root;
-            hit_anything = true;
+  aabb bounding_box() const override {
+    vec3 half(radius, height / 2.0, radius);
+    return aabb(center - half, center + half);
+  }
 
-            temp_rec.t = root;
-            temp_rec.p = r.at(root);
+private:
+  // Golpe mas cercano entre el contorno y las tapas, sin atributos.
+  // face: 0 = contorno, -1 = tapa inferior, 1 = tapa superior
+  bool closest_t(const ray& r, interval ray_t, real& t_hit, int& face) const {
+    bool hit_anything = false;
+    real closest_t = ray_t.max;
 
-            vec3 outward_normal = unit_vector(
-              vec3(temp_rec.p.x() - center.x(),
-                   0,
-                   temp_rec.p.z() - center.z())
-            );
+    vec3 oc = r.origin() - center;
+    real half_h = height / 2.0;
 
-            temp_rec.set_face_normal(r, outward_normal);
-            temp_rec.mat = mat;
-          }
-        }
-      }
-    }
+    // Contorno
 
-    // Tapa inferior
+    real a = r.direction().x()*r.direction().x()
+             + r.direction().z()*r.direction().z();
+    real b = 2*(oc.x()*r.direction().x() + oc.z()*r.direction().z());
+    real c = oc.x()*oc.x() + oc.z()*oc.z() - radius*radius;
 
-    double y_bottom = center.y() - half_h;
-    double denom = r.direction().y();
+    real discriminant = b*b - 4*a*c;
 
-    if (fabs(denom) > 1e-8) {
-      double t = (y_bottom - r.origin().y()) / denom;
+    if (discriminant >= 0) {
+      real sqrtd = sqrt(discriminant);
 
-      if (ray_t.surrounds(t) && t < closest_t) {
-        point3 p = r.at(t);
+      real root = (-b - sqrtd) / (2*a);
+      if (!ray_t.surrounds(root))
+        root = (-b + sqrtd) / (2*a);
 
-        double dx = p.x() - center.x();
-        double dz = p.z() - center.z();
+      if (ray_t.surrounds(root)) {
+        real y = oc.y() + root * r.direction().y();
 
-        if (dx*dx + dz*dz <= radius*radius) {
-          closest_t = t;
+        if (y >= -half_h && y <= half_h && root < closest_t) {
+          closest_t = root;
+          face = 0;
           hit_anything = true;
-
-          temp_rec.t = t;
-          temp_rec.p = p;
-
-          temp_rec.set_face_normal(r, vec3(0, -1, 0));
-          temp_rec.mat = mat;
         }
       }
     }
 
-    // Tapa superior
+    // Tapas, primero la inferior
 
-    double y_top = center.y() + half_h;
+    real denom = r.direction().y();
 
     if (fabs(denom) > 1e-8) {
-      double t = (y_top - r.origin().y()) / denom;
+      for (int side = -1; side <= 1; side += 2) {
+        real y_cap = center.y() + side * half_h;
+        real t = (y_cap - r.origin().y()) / denom;
 
-      if (ray_t.surrounds(t) && t < closest_t) {
-        point3 p = r.at(t);
+        if (ray_t.surrounds(t) && t < closest_t) {
+          point3 p = r.at(t);
 
-        double dx = p.x() - center.x();
-        double dz = p.z() - center.z();
-
-        if (dx*dx + dz*dz <= radius*radius) {
-          closest_t = t;
-          hit_anything = true;
+          real dx = p.x() - center.x();
+          real dz = p.z() - center.z();
 
-          temp_rec.t = t;
-          temp_rec.p = p;
-
-          temp_rec.set_face_normal(r, vec3(0, 1, 0));
-          temp_rec.mat = mat;
+          if (dx*dx + dz*dz <= radius*radius) {
+            closest_t = t;
+            face = side;
+            hit_anything = true;
+          }
         }
       }
     }
 
     if (hit_anything)
-      rec = temp_rec;
-
+      t_hit = closest_t;
     return hit_anything;
   }
 };
@@ -1,19 +1,24 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.h"
 #include "ray.h"
 
+#include <cstdint>
+
 class material;
 
 class hit_record {
   public:
     point3 p;
-    double u;
-    double v;
+    real u;
+    real v;
     vec3 normal;
-		shared_ptr<material> mat;
-    double t;
+		const material* mat = nullptr; // Sin dueño, el objeto golpeado mantiene vivo al material
+    real t;
 		bool front_face;
+    real uv_density = 0;    // Cuanto cambian u,v por unidad de distancia en la superficie, 0 = sin uv
+    real uv_footprint = 0;  // Ancho en uv que cubre un pixel en el golpe, lo pone la camara
 	
     void set_face_normal(const ray& r, const vec3& outward_normal) {
 
@@ -22,11 +27,82 @@ class hit_record {
     }
 };
 
+class hittable;
+
+// Camino hasta el primitivo ganador de hit_distance(). Cada agregado (lista, BVH,
+// malla) anota en steps[nivel] su hijo ganador, del mas externo al mas interno, y
+// hit_winner() lo sigue para completar el golpe sin volver a recorrer nada.
+// Un agregado lee su nivel en depth al entrar; al ganar deja depth despues del
+// ultimo paso anotado. Si un hijo gana sin anotar nada (un primitivo simple), su
+// padre guarda en leaf_max el tope del intervalo con que lo encontro.
+struct hit_path {
+    static const int max_depth = 8;  // Mas anidado no se anota y se completa con hit()
+
+    struct step {
+        const hittable* object;  // Hijo ganador, en listas y BVH de punteros
+        uint32_t index;          // Primitivo ganador, en el BVH lineal y las mallas
+    };
+
+    step steps[max_depth];
+    int  depth = 0;
+    real leaf_max = 0;
+};
+
 class hittable {
   public:
     virtual ~hittable() = default;
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    // Golpe diferido: solo la distancia t, la misma que daria hit(). Las listas y
+    // los BVH buscan el mas cercano con esto y al final completan el golpe del
+    // ganador con hit_winner(), asi punto, normal, uv y material no se calculan
+    // para candidatos que despues tapa otro objeto. Los primitivos no usan path.
+    virtual bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const {
+        hit_record rec;
+        if (!hit(r, ray_t, rec))
+            return false;
+        t = rec.t;
+        return true;
+    }
+
+    // Completa el golpe que encontro hit_distance() siguiendo path desde level.
+    // ray_t va hasta path.leaf_max. Un primitivo simplemente vuelve a llamar hit().
+    virtual bool hit_winner(const ray& r, interval ray_t, const hit_path&, int, hit_record& rec) const {
+        return hit(r, ray_t, rec);
+    }
+
+    // Interseccion de una oleada de rayos (modo wavefront): hits[k] dice si rays[k]
+    // golpea algo dentro de ray_t y recs[k] es su golpe. Por defecto un hit() por rayo.
+    virtual void hit_batch(const ray* rays, int count, interval ray_t, hit_record* recs, unsigned char* hits) const {
+        for (int k = 0; k < count; k++)
+            hits[k] = hit(rays[k], ray_t, recs[k]);
+    }
+
+    // Solo dice si algo corta el rayo dentro de ray_t, sin buscar el golpe mas
+    // cercano ni calcular punto, normal o uv. Lo usan los rayos de sombra.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
+    virtual aabb bounding_box() const = 0;
+
+    // Muestreo de luces: densidad (por angulo solido) de que random(origin)
+    // devuelva `direction`, y una direccion al azar desde origin hacia el objeto.
+    // Solo las primitivas que pueden ser luces las implementan.
+    virtual double pdf_value(const point3&, const vec3&) const { return 0.0; }
+
+    virtual vec3 random(const point3&) const { return vec3(1,0,0); }
+
+  protected:
+    // hit() de los agregados: busca el ganador por distancia y completa solo ese
+    bool hit_deferred(const ray& r, interval ray_t, hit_record& rec) const {
+        real t;
+        hit_path path;
+        return hit_distance(r, ray_t, t, path)
+            && hit_winner(r, interval(ray_t.min, path.leaf_max), path, 0, rec);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "hittable.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -16,27 +17,78 @@ class hittable_list : public hittable {
     hittable_list() {}
     hittable_list(shared_ptr<hittable> object) { add(object); }
 
-    void clear() { objects.clear(); }
+    void clear() { objects.clear(); bbox = aabb(); }
 
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
+        bbox = aabb(bbox, object->bounding_box());
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        hit_record temp_rec;
-        bool hit_anything = false;
-        auto closest_so_far = ray_t.max;
+        return hit_deferred(r, ray_t, rec);
+    }
+
+    // Anota el objeto ganador en su nivel de path
+    bool hit_distance(const ray& r, interval ray_t, real& t, hit_path& path) const override {
+        int level = path.depth;
+        const hittable* winner = nullptr;
+        int winner_depth = level;
+        real closest_so_far = ray_t.max;
 
         for (const auto& object : objects) {
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
-                hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+            real object_t;
+            path.depth = level + 1;
+            if (object->hit_distance(r, interval(ray_t.min, closest_so_far), object_t, path)) {
+                if (path.depth == level + 1)
+                    path.leaf_max = closest_so_far;
+                winner = object.get();
+                winner_depth = path.depth;
+                closest_so_far = object_t;
             }
         }
 
-        return hit_anything;
+        t = closest_so_far;
+        path.depth = level;
+        if (winner && level < hit_path::max_depth) {
+            path.steps[level].object = winner;
+            path.depth = winner_depth;
+        }
+        return winner != nullptr;
+    }
+
+    bool hit_winner(const ray& r, interval ray_t, const hit_path& path, int level, hit_record& rec) const override {
+        if (level >= path.depth)
+            return hit(r, ray_t, rec);
+        return path.steps[level].object->hit_winner(r, ray_t, path, level + 1, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const auto& object : objects)
+            if (object->occluded(r, ray_t))
+                return true;
+        return false;
     }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // Mezcla uniforme de las densidades de todos los objetos
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (objects.empty())
+            return 0.0;
+
+        double sum = 0.0;
+        for (const auto& object : objects)
+            sum += object->pdf_value(origin, direction);
+        return sum / objects.size();
+    }
+
+    vec3 random(const point3& origin) const override {
+        size_t index = std::min(size_t(random_double() * objects.size()), objects.size() - 1);
+        return objects[index]->random(origin);
+    }
+
+  private:
+    aabb bbox;
 };
 
 #endif
\ No newline at end of file
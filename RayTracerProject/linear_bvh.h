@@ -0,0 +1,527 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "bvh.h"
+#include "rectangle.h"
+#include "sphere.h"
+#include "sphere_simd.h"
+
+#include <cstdint>
+
+// Nodo del BVH lineal, mide 32 bytes para que quepan dos por linea de cache.
+// Los nodos estan en orden de profundidad: el primer hijo es el nodo siguiente
+// y offset apunta al segundo. En una hoja offset es el primer primitivo y count cuantos hay.
+struct linear_bvh_node {
+    float    bounds_min[3];
+    float    bounds_max[3];
+    uint32_t offset;
+    uint16_t count;  // 0 = nodo interior
+    uint8_t  axis;   // Eje de corte, el primer hijo queda del lado negativo
+    uint8_t  pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node debe medir 32 bytes");
+
+// Los limites se guardan en float redondeando hacia afuera, asi la caja nunca queda chica
+inline float bvh_round_down(double x) {
+    float f = float(x);
+    return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float bvh_round_up(double x) {
+    float f = float(x);
+    return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+// Prueba de losas del rayo contra la caja de un nodo
+inline bool hit_linear_node(const linear_bvh_node& node, const point3& orig, const vec3& inv_dir, interval ray_t) {
+    for (int a = 0; a < 3; a++) {
+        real t0 = (node.bounds_min[a] - orig[a]) * inv_dir[a];
+        real t1 = (node.bounds_max[a] - orig[a]) * inv_dir[a];
+        if (inv_dir[a] < 0) std::swap(t0, t1);
+
+        if (t0 > ray_t.min) ray_t.min = t0;
+        if (t1 < ray_t.max) ray_t.max = t1;
+        if (ray_t.max <= ray_t.min)
+            return false;
+    }
+    return true;
+}
+
+// BVH aplanado en un arreglo. Las esferas, rectangulos y cajas se copian a arreglos
+// propios de cada tipo y se prueban directamente, sin punteros ni llamadas virtuales.
+// Las esferas de cada hoja se guardan juntas en un paquete SIMD (ver sphere_simd.h).
+// Lo demas (cilindros, transformaciones...) queda en `others` y se llama por
+// hit_distance() y hit_winner().
+class linear_bvh : public hittable {
+  public:
+    linear_bvh(const hittable_list& list) : source(list) {
+        auto start_time = std::chrono::steady_clock::now();
+
+        std::vector<build_item> items;
+        for (const auto& object : list.objects)
+            add_primitive(object, items);
+
+        if (!items.empty())
+            build(items, 0, items.size(), 0);
+        bbox = list.bounding_box();
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+        std::clog << "BVH lineal: " << items.size() << " primitivos (" << spheres.size() << " esferas en "
+                  << sphere_packets.size() << " paquetes, " << rects.size() << " rectangulos, "
+                  << boxes.size() << " cajas, "
+                  << others.size() << " otros), " << nodes.size() << " nodos, " << elapsed.count() << " ms\n";
+
+        // Los datos ya quedaron copiados en los paquetes
+        spheres.clear();
+        spheres.shrink_to_fit();
+    }
+
+    // El recorrido solo busca la distancia; el golpe completo se calcula al final
+    // para el primitivo ganador, con el intervalo con que se encontro
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_deferred(r, ray_t, rec);
+    }
+
+    // Anota la referencia del primitivo ganador en su nivel de path
+    bool hit_distance(const ray& r, interval ray_t, real& t, hit_path& path) const override {
+        int level = path.depth;
+        int winner_depth = level;
+        uint32_t winner;
+        bool found = closest(r, ray_t, t, winner, path, level, winner_depth);
+
+        path.depth = level;
+        if (found && level < hit_path::max_depth) {
+            path.steps[level].index = winner;
+            path.depth = winner_depth;
+        }
+        return found;
+    }
+
+    bool hit_winner(const ray& r, interval ray_t, const hit_path& path, int level, hit_record& rec) const override {
+        if (level >= path.depth)
+            return hit(r, ray_t, rec);
+        return hit_primitive(path.steps[level].index, r, ray_t, path, level + 1, rec);
+    }
+
+    // Recorrido por flujo de rayos para el modo wavefront: el arbol se baja una sola vez
+    // para un grupo de rayos y cada nodo recibe la lista de rayos que tocaron la caja de
+    // su padre. Los que no tocan la suya se filtran y si no queda ninguno el subarbol se
+    // salta; los primitivos de una hoja se prueban contra todos los rayos que llegaron,
+    // asi nodos y primitivos se leen una vez por grupo en vez de una por rayo. Los rayos
+    // se agrupan por octante de su direccion para que todos visiten primero el mismo hijo.
+    void hit_batch(const ray* rays, int count, interval ray_t, hit_record* recs, unsigned char* hits) const override {
+        if (nodes.empty() || count == 0) {
+            std::fill(hits, hits + count, 0);
+            return;
+        }
+
+        // Memoria de trabajo de cada hilo, se reutiliza entre oleadas
+        static thread_local std::vector<batch_ray> state;
+        static thread_local std::vector<hit_path> paths;
+        static thread_local std::vector<uint32_t> order, ids;
+        if (state.size() < size_t(count)) {
+            state.resize(count);
+            paths.resize(count);
+            order.resize(count);
+        }
+
+        int octant_start[9] = {0};
+        for (int k = 0; k < count; k++) {
+            const vec3& d = rays[k].direction();
+            batch_ray& b = state[k];
+            b.inv_dir = vec3(1.0 / d.x(), 1.0 / d.y(), 1.0 / d.z());
+            b.t_max = ray_t.max;
+            b.winner_depth = 0;
+            b.octant = (b.inv_dir.x() < 0) | ((b.inv_dir.y() < 0) << 1) | ((b.inv_dir.z() < 0) << 2);
+            octant_start[b.octant + 1]++;
+        }
+        for (int o = 0; o < 8; o++)
+            octant_start[o + 1] += octant_start[o];
+        int fill[8];
+        std::copy(octant_start, octant_start + 8, fill);
+        for (int k = 0; k < count; k++)
+            order[fill[state[k].octant]++] = uint32_t(k);
+
+        for (int o = 0; o < 8; o++) {
+            if (octant_start[o] < octant_start[o + 1]) {
+                ids.assign(order.begin() + octant_start[o], order.begin() + octant_start[o + 1]);
+                traverse_stream(rays, ray_t.min, o, state, paths, ids);
+            }
+        }
+
+        // Cada golpe se completa siguiendo su camino, como hit()
+        for (int k = 0; k < count; k++) {
+            hits[k] = 0;
+            if (state[k].winner_depth == 0)
+                continue;
+            hit_path& path = paths[k];
+            path.steps[0].index = state[k].winner;
+            path.depth = state[k].winner_depth;
+            hits[k] = hit_winner(rays[k], interval(ray_t.min, path.leaf_max), path, 0, recs[k]);
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // Mismo recorrido que closest() pero sin orden de visita ni achicar ray_t:
+    // termina con el primer primitivo que corte el rayo
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (nodes.empty())
+            return false;
+
+        const point3& orig = r.origin();
+        vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+
+        uint32_t stack[max_stack];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const linear_bvh_node& node = nodes[current];
+
+            if (hit_linear_node(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+                        if (occluded_primitive(prim_refs[i], r, ray_t))
+                            return true;
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        return false;
+    }
+
+  private:
+    // Referencia a primitivo: los 2 bits altos dicen el tipo y el resto el indice en su arreglo.
+    // Durante la construccion kind_sphere indexa `spheres`, en el arbol final indexa un paquete.
+    static const uint32_t kind_sphere = 0;
+    static const uint32_t kind_rect   = 1;
+    static const uint32_t kind_other  = 2;
+    static const uint32_t kind_box    = 3;
+    static const uint32_t kind_shift  = 30;
+    static const uint32_t index_mask  = (1u << kind_shift) - 1;
+
+    static const int max_leaf_size = sphere_set::width;
+    static const int max_stack     = 64;
+    static const int max_sah_depth = 40;  // Mas abajo cortamos por la mitad para acotar la pila
+
+    struct rect_prim {
+        int normal_axis;
+        real a0, a1, b0, b1, k;
+        const material* mat;
+    };
+
+    struct box_prim {
+        point3 lo, hi;
+        const material* mat;
+    };
+
+    struct build_item {
+        uint32_t ref;
+        aabb box;
+    };
+
+    // Estado de cada rayo en hit_batch()
+    struct batch_ray {
+        vec3     inv_dir;
+        real     t_max;
+        uint32_t winner;
+        int      winner_depth;  // 0 = sin golpe, si no donde termina su camino
+        int      octant;        // Bit a prendido si la direccion es negativa en el eje a
+    };
+
+    std::vector<linear_bvh_node> nodes;
+    std::vector<uint32_t> prim_refs;
+    std::vector<sphere_data> spheres;
+    sphere_set sphere_packets;
+    std::vector<rect_prim> rects;
+    std::vector<box_prim> boxes;
+    std::vector<shared_ptr<hittable>> others;
+    hittable_list source;  // Mantiene vivos los objetos y sus materiales
+    aabb bbox;
+
+    void add_primitive(const shared_ptr<hittable>& object, std::vector<build_item>& items) {
+        const hittable* obj = object.get();
+        uint32_t ref;
+
+        if (auto s = dynamic_cast<const sphere*>(obj)) {
+            ref = (kind_sphere << kind_shift) | uint32_t(spheres.size());
+            spheres.push_back({s->get_center(), s->get_radius(), s->get_material().get()});
+        } else if (auto q = dynamic_cast<const xy_rect*>(obj)) {
+            ref = (kind_rect << kind_shift) | uint32_t(rects.size());
+            rects.push_back({2, q->x0, q->x1, q->y0, q->y1, q->k, q->mat.get()});
+        } else if (auto q = dynamic_cast<const xz_rect*>(obj)) {
+            ref = (kind_rect << kind_shift) | uint32_t(rects.size());
+            rects.push_back({1, q->x0, q->x1, q->z0, q->z1, q->k, q->mat.get()});
+        } else if (auto q = dynamic_cast<const yz_rect*>(obj)) {
+            ref = (kind_rect << kind_shift) | uint32_t(rects.size());
+            rects.push_back({0, q->y0, q->y1, q->z0, q->z1, q->k, q->mat.get()});
+        } else if (auto b = dynamic_cast<const box*>(obj)) {
+            ref = (kind_box << kind_shift) | uint32_t(boxes.size());
+            boxes.push_back({b->box_min, b->box_max, b->mat.get()});
+        } else if (auto l = dynamic_cast<const hittable_list*>(obj)) {
+            for (const auto& child : l->objects)
+                add_primitive(child, items);
+            return;
+        } else {
+            ref = (kind_other << kind_shift) | uint32_t(others.size());
+            others.push_back(object);
+        }
+
+        items.push_back({ref, object->bounding_box()});
+    }
+
+    uint32_t build(std::vector<build_item>& items, size_t start, size_t end, int depth) {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        aabb box;
+        for (size_t i = start; i < end; i++)
+            box = aabb(box, items[i].box);
+
+        linear_bvh_node node = {};
+        for (int a = 0; a < 3; a++) {
+            node.bounds_min[a] = bvh_round_down(box.axis_interval(a).min);
+            node.bounds_max[a] = bvh_round_up(box.axis_interval(a).max);
+        }
+
+        size_t count = end - start;
+        if (count <= size_t(max_leaf_size)) {
+            node.offset = uint32_t(prim_refs.size());
+
+            // Las esferas de la hoja van juntas en un paquete
+            sphere_data leaf_spheres[sphere_set::width];
+            int sphere_count = 0;
+            for (size_t i = start; i < end; i++) {
+                uint32_t ref = items[i].ref;
+                if ((ref >> kind_shift) == kind_sphere)
+                    leaf_spheres[sphere_count++] = spheres[ref & index_mask];
+                else
+                    prim_refs.push_back(ref);
+            }
+            if (sphere_count > 0) {
+                uint32_t packet = sphere_packets.add_packet(leaf_spheres, sphere_count);
+                prim_refs.push_back((kind_sphere << kind_shift) | packet);
+            }
+
+            node.count = uint16_t(prim_refs.size() - node.offset);
+            nodes[index] = node;
+            return index;
+        }
+
+        size_t mid = (depth < max_sah_depth)
+            ? sah_partition(items, start, end, [](const build_item& item) { return item.box; })
+            : start + count / 2;
+
+        // El eje donde mas se separan los centroides de los hijos decide el orden de visita
+        aabb left_box, right_box;
+        for (size_t i = start; i < mid; i++) left_box = aabb(left_box, items[i].box);
+        for (size_t i = mid; i < end; i++) right_box = aabb(right_box, items[i].box);
+        vec3 separation = right_box.centroid() - left_box.centroid();
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (std::fabs(separation[a]) > std::fabs(separation[axis])) axis = a;
+
+        // El primer hijo en el arreglo siempre es el del lado negativo del eje
+        uint32_t second;
+        if (separation[axis] < 0) {
+            build(items, mid, end, depth + 1);
+            second = build(items, start, mid, depth + 1);
+        } else {
+            build(items, start, mid, depth + 1);
+            second = build(items, mid, end, depth + 1);
+        }
+
+        node.offset = second;
+        node.count = 0;
+        node.axis = uint8_t(axis);
+        nodes[index] = node;
+        return index;
+    }
+
+    // Baja el arbol con los rayos de ids, todos del mismo octante. Cada entrada de la
+    // pila es un nodo y el tramo [first, last) de ids con los rayos que le llegan; lo
+    // que esta en ids despues de last es de subarboles ya terminados y se descarta.
+    void traverse_stream(const ray* rays, real t_min, int octant, std::vector<batch_ray>& state,
+                         std::vector<hit_path>& paths, std::vector<uint32_t>& ids) const {
+        struct stream_entry {
+            uint32_t node;
+            uint32_t first, last;
+        };
+        stream_entry stack[max_stack];
+        int stack_size = 0;
+        stream_entry current = { 0, 0, uint32_t(ids.size()) };
+
+        while (true) {
+            const linear_bvh_node& node = nodes[current.node];
+
+            ids.resize(current.last);
+            uint32_t first = current.last;
+            for (uint32_t n = current.first; n < current.last; n++) {
+                uint32_t k = ids[n];
+                if (hit_linear_node(node, rays[k].origin(), state[k].inv_dir, interval(t_min, state[k].t_max)))
+                    ids.push_back(k);
+            }
+            uint32_t last = uint32_t(ids.size());
+
+            if (first < last && node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    for (uint32_t n = first; n < last; n++) {
+                        uint32_t k = ids[n];
+                        batch_ray& b = state[k];
+                        hit_path& path = paths[k];
+                        real prim_t;
+                        path.depth = 1;
+                        if (distance_primitive(prim_refs[i], rays[k], interval(t_min, b.t_max), prim_t, path)) {
+                            if (path.depth == 1)
+                                path.leaf_max = b.t_max;
+                            b.winner = prim_refs[i];
+                            b.winner_depth = path.depth;
+                            b.t_max = prim_t;
+                        }
+                    }
+                }
+            } else if (first < last) {
+                // Mismo orden de visita que closest(), comun a todo el octante
+                bool dir_neg = (octant >> node.axis) & 1;
+                uint32_t near_child = dir_neg ? node.offset : current.node + 1;
+                uint32_t far_child  = dir_neg ? current.node + 1 : node.offset;
+                stack[stack_size++] = { far_child, first, last };
+                current = { near_child, first, last };
+                continue;
+            }
+
+            if (stack_size == 0) break;
+            current = stack[--stack_size];
+        }
+    }
+
+    // Primitivo con el golpe mas cercano y su t. Los de `others` anotan su camino en
+    // path a partir de level + 1; winner_depth es donde termina el del ganador.
+    bool closest(const ray& r, interval ray_t, real& t, uint32_t& winner, hit_path& path, int level, int& winner_depth) const {
+        if (nodes.empty())
+            return false;
+
+        const point3& orig = r.origin();
+        vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+        bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        uint32_t stack[max_stack];
+        int stack_size = 0;
+        uint32_t current = 0;
+        bool hit_anything = false;
+
+        while (true) {
+            const linear_bvh_node& node = nodes[current];
+
+            if (hit_linear_node(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        real prim_t;
+                        path.depth = level + 1;
+                        if (distance_primitive(prim_refs[i], r, ray_t, prim_t, path)) {
+                            if (path.depth == level + 1)
+                                path.leaf_max = ray_t.max;
+                            hit_anything = true;
+                            winner = prim_refs[i];
+                            winner_depth = path.depth;
+                            ray_t.max = prim_t;
+                        }
+                    }
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else if (dir_neg[node.axis]) {
+                    // El rayo va hacia el lado negativo, el segundo hijo esta mas cerca
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        t = ray_t.max;
+        return hit_anything;
+    }
+
+    bool distance_primitive(uint32_t ref, const ray& r, interval ray_t, real& t, hit_path& path) const {
+        uint32_t index = ref & index_mask;
+
+        switch (ref >> kind_shift) {
+            case kind_sphere:
+                return sphere_packets.hit_distance(index, r, ray_t, t);
+            case kind_rect: {
+                const rect_prim& q = rects[index];
+                return axis_rect_t(q.normal_axis, q.a0, q.a1, q.b0, q.b1, q.k, r, ray_t, t);
+            }
+            case kind_box: {
+                int axis;
+                return box_slab_t(boxes[index].lo, boxes[index].hi, r, ray_t, t, axis);
+            }
+            default:
+                return others[index]->hit_distance(r, ray_t, t, path);
+        }
+    }
+
+    // path y level solo los usan los de `others`, para seguir su propio camino
+    bool hit_primitive(uint32_t ref, const ray& r, interval ray_t, const hit_path& path, int level, hit_record& rec) const {
+        uint32_t index = ref & index_mask;
+
+        switch (ref >> kind_shift) {
+            case kind_sphere:
+                return sphere_packets.hit(index, r, ray_t, rec);
+            case kind_rect: {
+                const rect_prim& q = rects[index];
+                if (!hit_axis_rect(q.normal_axis, q.a0, q.a1, q.b0, q.b1, q.k, r, ray_t, rec))
+                    return false;
+                rec.mat = q.mat;
+                return true;
+            }
+            case kind_box: {
+                const box_prim& b = boxes[index];
+                if (!hit_box_slab(b.lo, b.hi, r, ray_t, rec))
+                    return false;
+                rec.mat = b.mat;
+                return true;
+            }
+            default:
+                return others[index]->hit_winner(r, ray_t, path, level, rec);
+        }
+    }
+
+    bool occluded_primitive(uint32_t ref, const ray& r, interval ray_t) const {
+        uint32_t index = ref & index_mask;
+
+        switch (ref >> kind_shift) {
+            case kind_sphere:
+                return sphere_packets.occluded(index, r, ray_t);
+            case kind_rect: {
+                const rect_prim& q = rects[index];
+                real t;
+                return axis_rect_t(q.normal_axis, q.a0, q.a1, q.b0, q.b1, q.k, r, ray_t, t);
+            }
+            case kind_box: {
+                real t;
+                int axis;
+                return box_slab_t(boxes[index].lo, boxes[index].hi, r, ray_t, t, axis);
+            }
+            default:
+                return others[index]->occluded(r, ray_t);
+        }
+    }
+};
+
+#endif
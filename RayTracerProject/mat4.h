@@ -4,9 +4,21 @@
 #include "vec3.h"
 #include <cmath>
 #include <iostream>
+#include <utility>
+
+#if defined(__AVX__) && !defined(RT_SINGLE_PRECISION)
+    #include <immintrin.h>
+    #define RT_AFFINE_AVX
+#elif (defined(__SSE2__) || defined(_M_X64)) && !defined(RT_SINGLE_PRECISION)
+    #include <emmintrin.h>
+    #define RT_AFFINE_SSE2
+#elif (defined(__SSE__) || defined(_M_X64)) && defined(RT_SINGLE_PRECISION)
+    #include <xmmintrin.h>
+    #define RT_AFFINE_SSE
+#endif
 
 struct Matrix4 {
-  double m[4][4];
+  real m[4][4];
 
   Matrix4() {
     // Matriz identidad
@@ -17,17 +29,17 @@ struct Matrix4 {
 
   // Multiplicación Matriz * Punto con coordenadas homogeneas
   point3 mult_point(const point3& p) const {
-    double x = p.x()*m[0][0] + p.y()*m[0][1] + p.z()*m[0][2] + m[0][3];
-    double y = p.x()*m[1][0] + p.y()*m[1][1] + p.z()*m[1][2] + m[1][3];
-    double z = p.x()*m[2][0] + p.y()*m[2][1] + p.z()*m[2][2] + m[2][3];
+    real x = p.x()*m[0][0] + p.y()*m[0][1] + p.z()*m[0][2] + m[0][3];
+    real y = p.x()*m[1][0] + p.y()*m[1][1] + p.z()*m[1][2] + m[1][3];
+    real z = p.x()*m[2][0] + p.y()*m[2][1] + p.z()*m[2][2] + m[2][3];
     return point3(x, y, z);
   }
 
   // Multiplicación Matriz * Vector coordenadas homogeneas
   vec3 mult_vec(const vec3& v) const {
-    double x = v.x()*m[0][0] + v.y()*m[0][1] + v.z()*m[0][2];
-    double y = v.x()*m[1][0] + v.y()*m[1][1] + v.z()*m[1][2];
-    double z = v.x()*m[2][0] + v.y()*m[2][1] + v.z()*m[2][2];
+    real x = v.x()*m[0][0] + v.y()*m[0][1] + v.z()*m[0][2];
+    real y = v.x()*m[1][0] + v.y()*m[1][1] + v.z()*m[1][2];
+    real z = v.x()*m[2][0] + v.y()*m[2][1] + v.z()*m[2][2];
     return vec3(x, y, z);
   }
   
@@ -40,16 +52,37 @@ struct Matrix4 {
     return res;
   }
 
-  // Inversa por G-J
+  // Umbral relativo para considerar singular una matriz
+  static constexpr real singular_epsilon = sizeof(real) == sizeof(float) ? real(1e-6) : real(1e-12);
+
+  // Ultima fila 0 0 0 1
+  bool is_affine() const {
+    return m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1;
+  }
+
+  // Inversa por G-J con pivoteo parcial: en cada columna se usa la fila con el
+  // pivote mas grande, asi una rotacion de 90 grados (ceros en la diagonal) tambien
+  // se invierte. Devuelve false si la matriz es singular.
   static bool inverse(const Matrix4& in, Matrix4& out) {
     Matrix4 mat = in;
     Matrix4 res; 
 
+    real largest = 0;
+    for (int i = 0; i < 4; i++)
+      for (int j = 0; j < 4; j++)
+        largest = std::fmax(largest, std::abs(mat.m[i][j]));
+
     for (int i = 0; i < 4; i++) {
-      double pivot = mat.m[i][i];
-      if (std::abs(pivot) < 1e-8) return false;
+      int p = i;
+      for (int k = i + 1; k < 4; k++)
+        if (std::abs(mat.m[k][i]) > std::abs(mat.m[p][i])) p = k;
+      if (!(std::abs(mat.m[p][i]) > singular_epsilon * largest)) return false;
+      if (p != i) {
+        std::swap(mat.m[p], mat.m[i]);
+        std::swap(res.m[p], res.m[i]);
+      }
 
-      double invPivot = 1.0 / pivot;
+      real invPivot = 1.0 / mat.m[i][i];
       for (int j = 0; j < 4; j++) {
         mat.m[i][j] *= invPivot;
         res.m[i][j] *= invPivot;
@@ -57,7 +90,7 @@ struct Matrix4 {
 
       for (int k = 0; k < 4; k++) {
         if (k != i) {
-          double factor = mat.m[k][i];
+          real factor = mat.m[k][i];
           for (int j = 0; j < 4; j++) {
             mat.m[k][j] -= factor * mat.m[i][j];
             res.m[k][j] -= factor * res.m[i][j];
@@ -68,49 +101,84 @@ struct Matrix4 {
     out = res;
     return true;
   }
+
+  // Inversa cerrada de una matriz afin: la parte 3x3 por cofactores y la
+  // traslacion queda -A^-1 t. Si no es afin usa la inversa general.
+  static bool affine_inverse(const Matrix4& in, Matrix4& out) {
+    if (!in.is_affine()) return inverse(in, out);
+
+    const real (&a)[4][4] = in.m;
+    real c00 = a[1][1]*a[2][2] - a[1][2]*a[2][1];
+    real c01 = a[1][2]*a[2][0] - a[1][0]*a[2][2];
+    real c02 = a[1][0]*a[2][1] - a[1][1]*a[2][0];
+    real det = a[0][0]*c00 + a[0][1]*c01 + a[0][2]*c02;
+
+    // |det| nunca pasa del producto de las normas de las filas, comparamos contra
+    // eso para que una escala chica pero valida no cuente como singular
+    real bound = 1;
+    for (int i = 0; i < 3; i++)
+      bound *= std::sqrt(a[i][0]*a[i][0] + a[i][1]*a[i][1] + a[i][2]*a[i][2]);
+    if (!(std::abs(det) > singular_epsilon * bound)) return false;
+
+    real inv_det = 1 / det;
+    Matrix4 res;
+    res.m[0][0] = c00 * inv_det;
+    res.m[1][0] = c01 * inv_det;
+    res.m[2][0] = c02 * inv_det;
+    res.m[0][1] = (a[0][2]*a[2][1] - a[0][1]*a[2][2]) * inv_det;
+    res.m[1][1] = (a[0][0]*a[2][2] - a[0][2]*a[2][0]) * inv_det;
+    res.m[2][1] = (a[0][1]*a[2][0] - a[0][0]*a[2][1]) * inv_det;
+    res.m[0][2] = (a[0][1]*a[1][2] - a[0][2]*a[1][1]) * inv_det;
+    res.m[1][2] = (a[0][2]*a[1][0] - a[0][0]*a[1][2]) * inv_det;
+    res.m[2][2] = (a[0][0]*a[1][1] - a[0][1]*a[1][0]) * inv_det;
+    for (int i = 0; i < 3; i++)
+      res.m[i][3] = -(res.m[i][0]*a[0][3] + res.m[i][1]*a[1][3] + res.m[i][2]*a[2][3]);
+    out = res;
+    return true;
+  }
   
   // Transformaciones
   
-  static Matrix4 translate(double x, double y, double z) {
+  static Matrix4 translate(real x, real y, real z) {
     Matrix4 res;
     res.m[0][3] = x; res.m[1][3] = y; res.m[2][3] = z;
     return res;
   }
 
-  static Matrix4 scale(double sx, double sy, double sz) {
+  static Matrix4 scale(real sx, real sy, real sz) {
     Matrix4 res;
     res.m[0][0] = sx; res.m[1][1] = sy; res.m[2][2] = sz;
     return res;
   }
 
-  static Matrix4 rotate_x(double degrees) {
+  static Matrix4 rotate_x(real degrees) {
     Matrix4 res;
-    double rad = degrees_to_radians(degrees);
-    double c = cos(rad), s = sin(rad);
+    real rad = degrees_to_radians(degrees);
+    real c = cos(rad), s = sin(rad);
     res.m[1][1] = c; res.m[1][2] = -s;
     res.m[2][1] = s; res.m[2][2] = c;
     return res;
   }
 
-  static Matrix4 rotate_y(double degrees) {
+  static Matrix4 rotate_y(real degrees) {
     Matrix4 res;
-    double rad = degrees_to_radians(degrees);
-    double c = cos(rad), s = sin(rad);
+    real rad = degrees_to_radians(degrees);
+    real c = cos(rad), s = sin(rad);
     res.m[0][0] = c; res.m[0][2] = s;
     res.m[2][0] = -s; res.m[2][2] = c;
     return res;
   }
 
-  static Matrix4 rotate_z(double degrees) {
+  static Matrix4 rotate_z(real degrees) {
     Matrix4 res;
-    double rad = degrees_to_radians(degrees);
-    double c = cos(rad), s = sin(rad);
+    real rad = degrees_to_radians(degrees);
+    real c = cos(rad), s = sin(rad);
     res.m[0][0] = c; res.m[0][1] = -s;
     res.m[1][0] = s; res.m[1][1] = c;
     return res;
   }
   
-  static Matrix4 shear(double xy, double xz, double yx, double yz, double zx, double zy) {
+  static Matrix4 shear(real xy, real xz, real yx, real yz, real zx, real zy) {
     Matrix4 res;
     res.m[0][1] = xy; res.m[0][2] = xz;
     res.m[1][0] = yx; res.m[1][2] = yz;
@@ -131,4 +199,105 @@ struct Matrix4 {
   }
 };
 
-#endif
\ No newline at end of file
+// Transformacion afin compacta: solo las 3 filas utiles de una Matrix4 (la
+// ultima siempre es 0 0 0 1). Se guarda por columnas con un carril de relleno
+// en 0, asi un punto se transforma con 3 multiplicaciones-suma SIMD sobre
+// columnas enteras en vez de 16 productos escalares.
+struct alignas(32) Matrix3x4 {
+  real col[4][4];  // col[j][i] = m[i][j], col[3] es la traslacion
+
+  Matrix3x4() {
+    for(int j=0; j<4; j++)
+      for(int i=0; i<4; i++)
+        col[j][i] = (i == j && j < 3) ? 1.0 : 0.0;
+  }
+
+  explicit Matrix3x4(const Matrix4& M) {
+    for(int j=0; j<4; j++) {
+      for(int i=0; i<3; i++)
+        col[j][i] = M.m[i][j];
+      col[j][3] = 0;
+    }
+  }
+
+  Matrix4 to_matrix4() const {
+    Matrix4 res;
+    for(int i=0; i<3; i++)
+      for(int j=0; j<4; j++)
+        res.m[i][j] = col[j][i];
+    return res;
+  }
+
+  point3 mult_point(const point3& p) const {
+#if defined(RT_AFFINE_AVX)
+    __m256d r = _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(col[0]), _mm256_set1_pd(p.x())),
+                              _mm256_mul_pd(_mm256_load_pd(col[1]), _mm256_set1_pd(p.y())));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_load_pd(col[2]), _mm256_set1_pd(p.z())));
+    r = _mm256_add_pd(r, _mm256_load_pd(col[3]));
+    alignas(32) real out[4];
+    _mm256_store_pd(out, r);
+    return point3(out[0], out[1], out[2]);
+#elif defined(RT_AFFINE_SSE2)
+    __m128d x = _mm_set1_pd(p.x()), y = _mm_set1_pd(p.y()), z = _mm_set1_pd(p.z());
+    alignas(16) real out[4];
+    for (int half = 0; half < 4; half += 2) {
+      __m128d r = _mm_add_pd(_mm_mul_pd(_mm_load_pd(col[0] + half), x), _mm_mul_pd(_mm_load_pd(col[1] + half), y));
+      r = _mm_add_pd(r, _mm_mul_pd(_mm_load_pd(col[2] + half), z));
+      _mm_store_pd(out + half, _mm_add_pd(r, _mm_load_pd(col[3] + half)));
+    }
+    return point3(out[0], out[1], out[2]);
+#elif defined(RT_AFFINE_SSE)
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_load_ps(col[0]), _mm_set1_ps(p.x())),
+                          _mm_mul_ps(_mm_load_ps(col[1]), _mm_set1_ps(p.y())));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(col[2]), _mm_set1_ps(p.z())));
+    r = _mm_add_ps(r, _mm_load_ps(col[3]));
+    alignas(16) real out[4];
+    _mm_store_ps(out, r);
+    return point3(out[0], out[1], out[2]);
+#else
+    return point3(col[0][0]*p.x() + col[1][0]*p.y() + col[2][0]*p.z() + col[3][0],
+                  col[0][1]*p.x() + col[1][1]*p.y() + col[2][1]*p.z() + col[3][1],
+                  col[0][2]*p.x() + col[1][2]*p.y() + col[2][2]*p.z() + col[3][2]);
+#endif
+  }
+
+  // Como mult_point pero sin traslacion
+  vec3 mult_vec(const vec3& v) const {
+#if defined(RT_AFFINE_AVX)
+    __m256d r = _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(col[0]), _mm256_set1_pd(v.x())),
+                              _mm256_mul_pd(_mm256_load_pd(col[1]), _mm256_set1_pd(v.y())));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_load_pd(col[2]), _mm256_set1_pd(v.z())));
+    alignas(32) real out[4];
+    _mm256_store_pd(out, r);
+    return vec3(out[0], out[1], out[2]);
+#elif defined(RT_AFFINE_SSE2)
+    __m128d x = _mm_set1_pd(v.x()), y = _mm_set1_pd(v.y()), z = _mm_set1_pd(v.z());
+    alignas(16) real out[4];
+    for (int half = 0; half < 4; half += 2) {
+      __m128d r = _mm_add_pd(_mm_mul_pd(_mm_load_pd(col[0] + half), x), _mm_mul_pd(_mm_load_pd(col[1] + half), y));
+      _mm_store_pd(out + half, _mm_add_pd(r, _mm_mul_pd(_mm_load_pd(col[2] + half), z)));
+    }
+    return vec3(out[0], out[1], out[2]);
+#elif defined(RT_AFFINE_SSE)
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_load_ps(col[0]), _mm_set1_ps(v.x())),
+                          _mm_mul_ps(_mm_load_ps(col[1]), _mm_set1_ps(v.y())));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(col[2]), _mm_set1_ps(v.z())));
+    alignas(16) real out[4];
+    _mm_store_ps(out, r);
+    return vec3(out[0], out[1], out[2]);
+#else
+    return vec3(col[0][0]*v.x() + col[1][0]*v.y() + col[2][0]*v.z(),
+                col[0][1]*v.x() + col[1][1]*v.y() + col[2][1]*v.z(),
+                col[0][2]*v.x() + col[1][2]*v.y() + col[2][2]*v.z());
+#endif
+  }
+
+  // Transpuesta de la parte 3x3 por un vector: con la inversa transforma normales
+  vec3 mult_transpose_vec(const vec3& v) const {
+    return vec3(col[0][0]*v.x() + col[0][1]*v.y() + col[0][2]*v.z(),
+                col[1][0]*v.x() + col[1][1]*v.y() + col[1][2]*v.z(),
+                col[2][0]*v.x() + col[2][1]*v.y() + col[2][2]*v.z());
+  }
+};
+
+#endif
@@ -2,60 +2,117 @@
 #define MATERIAL_H
 
 #include "hittable.h"
+#include "onb.h"
 #include "texture.h"
 
+// Clase concreta de cada material, el modo wavefront la usa para agrupar golpes.
+// Las clases con kind() propio son final: una subclase heredaria su kind() y el
+// wavefront la trataria como la clase base. count es el numero de clases.
+enum class material_kind { generic, lambertian, metal, dielectric, diffuse_light, phong, count };
+
+// Rebote elegido por material::sample
+struct scatter_sample {
+    vec3   direction;
+    color  weight;              // eval / pdf, o la atenuacion en un lobulo delta
+    double pdf = 0;
+    bool   is_specular = false; // Lobulo delta: eval y pdf no aplican y no entra en MIS
+};
 
+// Cada material expone tres operaciones sobre la direccion de salida:
+// sample la elige al azar, eval devuelve BRDF * coseno y pdf la densidad con
+// que sample la habria elegido. Con eval y pdf el integrador puede combinar
+// el rebote con el muestreo de luces.
 class material {
   public:
     virtual ~material() = default;
 
-    virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const {
+    virtual material_kind kind() const { return material_kind::generic; }
+
+    virtual bool sample(const ray& r_in, const hit_record& rec, scatter_sample& s) const {
       return false;
     }
+
+    virtual color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+      return color(0,0,0);
+    }
+
+    virtual double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+      return 0;
+    }
+
 		virtual color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const {
       return color(0,0,0);
     }
+
+    // Atajo para quien solo necesita el rayo rebotado y su atenuacion
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const {
+      scatter_sample s;
+      if (!sample(r_in, rec, s))
+        return false;
+      attenuation = s.weight;
+      scattered = ray(rec.p, s.direction);
+      return true;
+    }
 };
 
-class lambertian : public material{
+class lambertian final : public material{
 	public:
 		lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
 		lambertian(shared_ptr<texture> tex) : tex(tex) {}
-		bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override{
-			auto scatter_direction = rec.normal + random_unit_vector();
-			if(scatter_direction.near_zero()){
-				scatter_direction = rec.normal;
-			}
-			scattered = ray(rec.p, scatter_direction);
-			attenuation = tex->value(rec.u, rec.v, rec.p);
+		material_kind kind() const override { return material_kind::lambertian; }
+		// Hemisferio con densidad coseno/pi, asi eval/pdf es justo el albedo
+		bool sample(const ray& r_in, const hit_record& rec, scatter_sample& s) const override{
+			onb uvw(rec.normal);
+			s.direction = uvw.transform(random_cosine_direction());
+			s.weight = tex->filtered_value(rec.u, rec.v, rec.p, rec.uv_footprint);
+			s.pdf = pdf(r_in, rec, s.direction);
+			s.is_specular = false;
 			return true;
 		}
 
+		color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override{
+			auto cos_theta = dot(rec.normal, unit_vector(direction));
+			if(cos_theta <= 0) return color(0,0,0);
+			return tex->filtered_value(rec.u, rec.v, rec.p, rec.uv_footprint) * (cos_theta/pi);
+		}
+
+		double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override{
+			auto cos_theta = dot(rec.normal, unit_vector(direction));
+			return cos_theta <= 0 ? 0 : cos_theta/pi;
+		}
+
 	private:
 	shared_ptr<texture>tex;
 };
 
-class metal : public material{
+class metal final : public material{
 	public:
 		metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+		material_kind kind() const override { return material_kind::metal; }
 
-		bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override{
+		// Lobulo delta (con fuzz apenas se ensancha), no se evalua
+		bool sample(const ray& r_in, const hit_record& rec, scatter_sample& s) const override{
 			vec3 reflected = reflect(r_in.direction(), rec.normal);
-			reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
-			scattered = ray(rec.p, reflected);
-			attenuation = albedo;
-			return (dot(scattered.direction(), rec.normal) > 0);
+			s.direction = unit_vector(reflected) + (fuzz * random_unit_vector());
+			s.weight = albedo;
+			s.pdf = 0;
+			s.is_specular = true;
+			return (dot(s.direction, rec.normal) > 0);
 		}
 	private:
 		color albedo;
 		double fuzz;
 };
 
-class dielectric : public material{
+class dielectric final : public material{
 	public:
 		dielectric(double refraction_index) : refraction_index(refraction_index) {}
-		bool scatter(const ray& r_in, const hit_record& rec, color& attenuation,  ray& scattered) const override{
-			attenuation = color(1.0, 1.0, 1.0);
+		material_kind kind() const override { return material_kind::dielectric; }
+		// Reflexion o refraccion segun Fresnel, las dos son lobulos delta
+		bool sample(const ray& r_in, const hit_record& rec, scatter_sample& s) const override{
+			s.weight = color(1.0, 1.0, 1.0);
+			s.pdf = 0;
+			s.is_specular = true;
 			double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
 
 			vec3 unit_direction = unit_vector(r_in.direction());
@@ -69,7 +126,7 @@ class dielectric : public material{
       else
         direction = refract(unit_direction, rec.normal, ri);
 
-      scattered = ray(rec.p, direction);
+      s.direction = direction;
 			return true;
 		}
 	private:
@@ -81,57 +138,81 @@ class dielectric : public material{
     }
 };
 
-class diffuse_light : public material {
+class diffuse_light final : public material {
   public:
     diffuse_light(shared_ptr<texture> tex) : tex(tex) {}
     diffuse_light(const color& emit) : tex(make_shared<solid_color>(emit)) {}
 
+    material_kind kind() const override { return material_kind::diffuse_light; }
+
     color emitted(const ray& r_in, const hit_record& r, double u, double v, const point3& p) const override {
-        return tex->value(u, v, p);
+        return tex->filtered_value(u, v, p, r.uv_footprint);
     }
 
   private:
     shared_ptr<texture> tex;
 };
 
-class phong_material : public material {
+// Phong modificado y normalizado: un lobulo difuso (1 - reflectivity) * albedo / pi
+// mas un lobulo especular blanco reflectivity * (n+2)/(2 pi) * cos^n alrededor
+// del reflejo, con n = shininess. Se muestrea eligiendo un lobulo con
+// probabilidad reflectivity y la pdf es la mezcla de las dos.
+class phong_material final : public material {
 public:
     color albedo;       // Color difuso 
-    double shininess;   // Que tan concentrado es el brillo
-    double reflectivity;// Probabilidad de que el rayo refleje brillo
+    double shininess;   // Exponente del lobulo especular
+    double reflectivity;// Peso del lobulo especular
 
+    // reflectivity se recorta a [0,1]: fuera de ahi el peso difuso seria negativo
+    // y la mezcla de pdfs dejaria de ser una densidad
     phong_material(const color& a, double s, double r) 
-        : albedo(a), shininess(s), reflectivity(r) {}
+        : albedo(a), shininess(s), reflectivity(interval(0,1).clamp(r)) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-        
+    material_kind kind() const override { return material_kind::phong; }
+
+    bool sample(const ray& r_in, const hit_record& rec, scatter_sample& s) const override {
         if (random_double() < reflectivity) {
-						// Luz especular
-            vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-            
-            // Shininess
-            double fuzz = (shininess > 1000.0) ? 0.0 : (1.0 - (shininess / 1000.0));
+            onb uvw(reflected_direction(r_in, rec));
+            s.direction = uvw.transform(random_phong_direction(shininess));
+        } else {
+            onb uvw(rec.normal);
+            s.direction = uvw.transform(random_cosine_direction());
+        }
 
-            // Generamos el rayo reflejado con un poco de aleatoriedad (fuzz)
-            scattered = ray(rec.p, unit_vector(reflected) + fuzz * random_unit_vector());
-            
-            // Color de brillo reflejado 
-            attenuation = color(1.0, 1.0, 1.0); 
+        // Si el lobulo especular mando el rayo bajo la superficie, se absorbe
+        s.pdf = pdf(r_in, rec, s.direction);
+        if (s.pdf <= 0)
+            return false;
+        s.weight = eval(r_in, rec, s.direction) / s.pdf;
+        s.is_specular = false;
+        return true;
+    }
 
-            // Si el rayo se metió dentro del objeto por el fuzz, lo invalidamos (absorbemos)
-            return (dot(scattered.direction(), rec.normal) > 0);
+    color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        vec3 wo = unit_vector(direction);
+        double cos_theta = dot(rec.normal, wo);
+        if (cos_theta <= 0)
+            return color(0,0,0);
 
-        } else {
-            // Esta es la parte de la luz difusa, igual al Lambertiano
-            vec3 scatter_direction = rec.normal + random_unit_vector();
-            
-            if (scatter_direction.near_zero())
-                scatter_direction = rec.normal;
-                
-            scattered = ray(rec.p, scatter_direction);
-            attenuation = albedo; 
-            return true;
-        }
+        double cos_alpha = std::fmax(dot(reflected_direction(r_in, rec), wo), 0.0);
+        double specular = reflectivity * (shininess + 2) / (2*pi) * std::pow(cos_alpha, shininess);
+        return ((1 - reflectivity) / pi * albedo + color(specular, specular, specular)) * cos_theta;
+    }
+
+    double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        vec3 wo = unit_vector(direction);
+        double cos_theta = dot(rec.normal, wo);
+        if (cos_theta <= 0)
+            return 0;
+
+        double cos_alpha = std::fmax(dot(reflected_direction(r_in, rec), wo), 0.0);
+        double pdf_specular = (shininess + 1) / (2*pi) * std::pow(cos_alpha, shininess);
+        return (1 - reflectivity) * cos_theta / pi + reflectivity * pdf_specular;
+    }
+
+private:
+    static vec3 reflected_direction(const ray& r_in, const hit_record& rec) {
+        return reflect(unit_vector(r_in.direction()), rec.normal);
     }
 };
-#endif
\ No newline at end of file
+#endif
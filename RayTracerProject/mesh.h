@@ -0,0 +1,318 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "bvh.h"
+#include "linear_bvh.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Malla de triangulos indexada: los vertices, normales y uv se guardan una sola
+// vez y cada triangulo apunta a ellos. Lleva su propio BVH lineal (mismos nodos
+// de 32 bytes que linear_bvh) y los triangulos se reordenan para que cada hoja
+// sea un rango contiguo del arreglo.
+class triangle_mesh : public hittable {
+  public:
+    struct triangle {
+        int v[3];  // Indices en positions
+        int n[3];  // Indices en normals, -1 = usar la normal geometrica
+        int t[3];  // Indices en uvs, -1 = usar las coordenadas baricentricas
+    };
+
+    triangle_mesh(std::vector<point3> positions, std::vector<vec3> normals, std::vector<vec3> uvs,
+                  std::vector<triangle> triangles, shared_ptr<material> mat)
+      : positions(std::move(positions)), normals(std::move(normals)), uvs(std::move(uvs)),
+        triangles(std::move(triangles)), mat(mat)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        std::vector<build_item> items;
+        items.reserve(this->triangles.size());
+        for (uint32_t i = 0; i < this->triangles.size(); i++) {
+            const triangle& tri = this->triangles[i];
+            aabb box(this->positions[tri.v[0]], this->positions[tri.v[1]]);
+            box = aabb(box, aabb(this->positions[tri.v[2]], this->positions[tri.v[2]]));
+            items.push_back({i, box});
+            bbox = aabb(bbox, box);
+        }
+
+        std::vector<triangle> ordered;
+        ordered.reserve(items.size());
+        if (!items.empty())
+            build(items, 0, items.size(), 0, ordered);
+        this->triangles = std::move(ordered);
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+        std::clog << "Malla: " << this->triangles.size() << " triangulos, " << this->positions.size()
+                  << " vertices, " << nodes.size() << " nodos, " << elapsed.count() << " ms\n";
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        real t, b1, b2, winner_max;
+        uint32_t winner;
+        if (!closest(r, ray_t, t, b1, b2, winner, winner_max))
+            return false;
+        fill_record(triangles[winner], r, t, b1, b2, rec);
+        return true;
+    }
+
+    // Anota el triangulo ganador en su nivel de path, con el tope con que se encontro
+    bool hit_distance(const ray& r, interval ray_t, real& t, hit_path& path) const override {
+        real b1, b2, winner_max;
+        uint32_t winner;
+        if (!closest(r, ray_t, t, b1, b2, winner, winner_max))
+            return false;
+
+        int level = path.depth;
+        if (level < hit_path::max_depth) {
+            path.steps[level].index = winner;
+            path.depth = level + 1;
+            path.leaf_max = winner_max;
+        }
+        return true;
+    }
+
+    // Solo se vuelve a intersecar el triangulo ganador, para sus baricentricas
+    bool hit_winner(const ray& r, interval ray_t, const hit_path& path, int level, hit_record& rec) const override {
+        if (level >= path.depth)
+            return hit(r, ray_t, rec);
+
+        const triangle& tri = triangles[path.steps[level].index];
+        real t, b1, b2;
+        if (!intersect(tri, r, ray_t, t, b1, b2))
+            return false;
+        fill_record(tri, r, t, b1, b2, rec);
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (nodes.empty())
+            return false;
+
+        const point3& orig = r.origin();
+        vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+
+        uint32_t stack[max_stack];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const linear_bvh_node& node = nodes[current];
+
+            if (hit_linear_node(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    real t, b1, b2;
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+                        if (intersect(triangles[i], r, ray_t, t, b1, b2))
+                            return true;
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        return false;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t triangle_count() const { return triangles.size(); }
+
+  private:
+    static const int max_leaf_size = 4;
+    static const int max_stack     = 64;
+    static const int max_sah_depth = 40;  // Mas abajo cortamos por la mitad para acotar la pila
+
+    struct build_item {
+        uint32_t index;
+        aabb box;
+    };
+
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<vec3> uvs;
+    std::vector<triangle> triangles;
+    std::vector<linear_bvh_node> nodes;
+    shared_ptr<material> mat;
+    aabb bbox;
+
+    // Misma construccion que linear_bvh: SAH por cubetas y el hijo del lado
+    // negativo primero. Las hojas copian sus triangulos en orden a `ordered`.
+    uint32_t build(std::vector<build_item>& items, size_t start, size_t end, int depth, std::vector<triangle>& ordered) {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        aabb box;
+        for (size_t i = start; i < end; i++)
+            box = aabb(box, items[i].box);
+
+        linear_bvh_node node = {};
+        for (int a = 0; a < 3; a++) {
+            node.bounds_min[a] = bvh_round_down(box.axis_interval(a).min);
+            node.bounds_max[a] = bvh_round_up(box.axis_interval(a).max);
+        }
+
+        size_t count = end - start;
+        if (count <= size_t(max_leaf_size)) {
+            node.offset = uint32_t(ordered.size());
+            node.count = uint16_t(count);
+            for (size_t i = start; i < end; i++)
+                ordered.push_back(triangles[items[i].index]);
+            nodes[index] = node;
+            return index;
+        }
+
+        size_t mid = (depth < max_sah_depth)
+            ? sah_partition(items, start, end, [](const build_item& item) { return item.box; })
+            : start + count / 2;
+
+        aabb left_box, right_box;
+        for (size_t i = start; i < mid; i++) left_box = aabb(left_box, items[i].box);
+        for (size_t i = mid; i < end; i++) right_box = aabb(right_box, items[i].box);
+        vec3 separation = right_box.centroid() - left_box.centroid();
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (std::fabs(separation[a]) > std::fabs(separation[axis])) axis = a;
+
+        uint32_t second;
+        if (separation[axis] < 0) {
+            build(items, mid, end, depth + 1, ordered);
+            second = build(items, start, mid, depth + 1, ordered);
+        } else {
+            build(items, start, mid, depth + 1, ordered);
+            second = build(items, mid, end, depth + 1, ordered);
+        }
+
+        node.offset = second;
+        node.count = 0;
+        node.axis = uint8_t(axis);
+        nodes[index] = node;
+        return index;
+    }
+
+    // Punto, normal y uv del golpe en tri con baricentricas b1, b2
+    void fill_record(const triangle& tri, const ray& r, real t, real b1, real b2, hit_record& rec) const {
+        const point3& p0 = positions[tri.v[0]];
+        vec3 geometric = unit_vector(cross(positions[tri.v[1]] - p0, positions[tri.v[2]] - p0));
+        real b0 = 1 - b1 - b2;
+
+        rec.t = t;
+        rec.p = r.at(t);
+
+        if (tri.n[0] >= 0) {
+            // Las normales del archivo dicen que lado es afuera, sin importar el orden de los vertices
+            vec3 shading = unit_vector(b0 * normals[tri.n[0]] + b1 * normals[tri.n[1]] + b2 * normals[tri.n[2]]);
+            if (dot(geometric, shading) < 0)
+                geometric = -geometric;
+            rec.set_face_normal(r, geometric);
+            rec.normal = rec.front_face ? shading : -shading;
+        } else {
+            rec.set_face_normal(r, geometric);
+        }
+
+        // Densidad de uv: raiz del area en uv sobre el area en el mundo del triangulo
+        real world_area = cross(positions[tri.v[1]] - p0, positions[tri.v[2]] - p0).length();
+        real uv_area = 1;  // Coordenadas baricentricas: el triangulo ocupa medio cuadrado unitario, x2 como world_area
+        if (tri.t[0] >= 0) {
+            vec3 uv = b0 * uvs[tri.t[0]] + b1 * uvs[tri.t[1]] + b2 * uvs[tri.t[2]];
+            rec.u = uv.x();
+            rec.v = uv.y();
+            uv_area = cross(uvs[tri.t[1]] - uvs[tri.t[0]], uvs[tri.t[2]] - uvs[tri.t[0]]).length();
+        } else {
+            rec.u = b1;
+            rec.v = b2;
+        }
+        rec.uv_density = (world_area > 0) ? std::sqrt(uv_area / world_area) : 0;
+
+        rec.mat = mat.get();
+    }
+
+    // Triangulo mas cercano, con su t, las coordenadas baricentricas del golpe y el
+    // tope del intervalo con que se encontro
+    bool closest(const ray& r, interval ray_t, real& t, real& b1, real& b2, uint32_t& winner, real& winner_max) const {
+        if (nodes.empty())
+            return false;
+
+        const point3& orig = r.origin();
+        vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+        bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        uint32_t stack[max_stack];
+        int stack_size = 0;
+        uint32_t current = 0;
+        bool hit_anything = false;
+
+        while (true) {
+            const linear_bvh_node& node = nodes[current];
+
+            if (hit_linear_node(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        if (intersect(triangles[i], r, ray_t, t, b1, b2)) {
+                            hit_anything = true;
+                            winner = i;
+                            winner_max = ray_t.max;
+                            ray_t.max = t;
+                        }
+                    }
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else if (dir_neg[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        t = ray_t.max;
+        return hit_anything;
+    }
+
+    // Moller-Trumbore: resuelve origen + t*dir = p0 + b1*e1 + b2*e2 con la regla de Cramer.
+    // Solo escribe t, b1 y b2 si hay golpe.
+    bool intersect(const triangle& tri, const ray& r, interval ray_t, real& t, real& b1, real& b2) const {
+        const point3& p0 = positions[tri.v[0]];
+        vec3 e1 = positions[tri.v[1]] - p0;
+        vec3 e2 = positions[tri.v[2]] - p0;
+
+        vec3 pvec = cross(r.direction(), e2);
+        real det = dot(e1, pvec);
+        if (det == 0)
+            return false;  // Rayo paralelo al plano
+        real inv_det = 1 / det;
+
+        vec3 tvec = r.origin() - p0;
+        real u = dot(tvec, pvec) * inv_det;
+        if (u < 0 || u > 1)
+            return false;
+
+        vec3 qvec = cross(tvec, e1);
+        real v = dot(r.direction(), qvec) * inv_det;
+        if (v < 0 || u + v > 1)
+            return false;
+
+        real root = dot(e2, qvec) * inv_det;
+        if (!ray_t.surrounds(root))
+            return false;
+
+        t = root;
+        b1 = u;
+        b2 = v;
+        return true;
+    }
+};
+
+#endif
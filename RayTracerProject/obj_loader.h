@@ -0,0 +1,127 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include "mesh.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+// Lee un indice de cara "v", "v/t", "v//n" o "v/t/n". Los indices del OBJ
+// empiezan en 1 y los negativos cuentan desde el final; aqui se devuelven desde 0.
+inline bool parse_obj_index(const char*& s, int count, int& index) {
+    char* end;
+    long value = std::strtol(s, &end, 10);
+    if (end == s)
+        return false;
+    s = end;
+
+    index = (value < 0) ? int(count + value) : int(value - 1);
+    return index >= 0 && index < count;
+}
+
+// Carga la geometria de un archivo OBJ (v, vt, vn y caras f; los poligonos se
+// parten en abanico). Lo demas (materiales, grupos) se ignora. Devuelve nullptr
+// si el archivo no se pudo abrir o no tiene triangulos.
+inline shared_ptr<triangle_mesh> load_obj(const std::string& path, shared_ptr<material> mat) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: No se pudo abrir el OBJ " << path << std::endl;
+        return nullptr;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<vec3> uvs;
+    std::vector<triangle_mesh::triangle> triangles;
+    std::vector<triangle_mesh::triangle> corners;  // Esquinas de la cara actual (solo [0] de cada arreglo)
+
+    std::string line;
+    int line_number = 0;
+    int skipped_faces = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        const char* s = line.c_str();
+        while (*s == ' ' || *s == '\t') s++;
+
+        if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+            char* end;
+            double x = std::strtod(s + 2, &end);
+            double y = std::strtod(end, &end);
+            double z = std::strtod(end, &end);
+            positions.push_back(point3(x, y, z));
+        } else if (s[0] == 'v' && s[1] == 'n') {
+            char* end;
+            double x = std::strtod(s + 2, &end);
+            double y = std::strtod(end, &end);
+            double z = std::strtod(end, &end);
+            normals.push_back(vec3(x, y, z));
+        } else if (s[0] == 'v' && s[1] == 't') {
+            char* end;
+            double u = std::strtod(s + 2, &end);
+            double v = std::strtod(end, &end);
+            uvs.push_back(vec3(u, v, 0));
+        } else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+            corners.clear();
+            s++;
+            bool ok = true;
+            while (ok) {
+                while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+                if (*s == '\0')
+                    break;
+
+                triangle_mesh::triangle c = {{-1, -1, -1}, {-1, -1, -1}, {-1, -1, -1}};
+                ok = parse_obj_index(s, int(positions.size()), c.v[0]);
+                if (ok && *s == '/') {
+                    s++;
+                    if (*s != '/')
+                        ok = parse_obj_index(s, int(uvs.size()), c.t[0]);
+                    if (ok && *s == '/') {
+                        s++;
+                        ok = parse_obj_index(s, int(normals.size()), c.n[0]);
+                    }
+                }
+                if (ok)
+                    corners.push_back(c);
+            }
+
+            if (!ok || corners.size() < 3) {
+                skipped_faces++;
+                continue;
+            }
+
+            // Si alguna esquina no trae normal o uv, el triangulo no usa ninguna
+            for (size_t k = 1; k + 1 < corners.size(); k++) {
+                const triangle_mesh::triangle* c[3] = { &corners[0], &corners[k], &corners[k + 1] };
+                triangle_mesh::triangle tri;
+                bool has_n = true, has_t = true;
+                for (int i = 0; i < 3; i++) {
+                    tri.v[i] = c[i]->v[0];
+                    tri.n[i] = c[i]->n[0];
+                    tri.t[i] = c[i]->t[0];
+                    has_n = has_n && tri.n[i] >= 0;
+                    has_t = has_t && tri.t[i] >= 0;
+                }
+                if (!has_n) tri.n[0] = tri.n[1] = tri.n[2] = -1;
+                if (!has_t) tri.t[0] = tri.t[1] = tri.t[2] = -1;
+                triangles.push_back(tri);
+            }
+        }
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+    std::clog << "OBJ " << path << ": " << line_number << " lineas, " << triangles.size() << " triangulos, "
+              << elapsed.count() << " ms\n";
+    if (skipped_faces > 0)
+        std::cerr << "Aviso: " << skipped_faces << " caras invalidas ignoradas en " << path << std::endl;
+
+    if (triangles.empty())
+        return nullptr;
+    return make_shared<triangle_mesh>(std::move(positions), std::move(normals), std::move(uvs),
+                                      std::move(triangles), mat);
+}
+
+#endif
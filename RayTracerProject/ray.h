@@ -12,7 +12,7 @@ class ray {
     const point3& origin() const  { return orig; }
     const vec3& direction() const { return dir; }
 
-    point3 at(double t) const {
+    point3 at(real t) const {
         return orig + t*dir;
     }
 
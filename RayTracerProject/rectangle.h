@@ -2,132 +2,285 @@
 #define RECT_H
 
 #include "hittable.h"
+#include "hittable_list.h"
 #include <memory>
 
 using std::make_shared;
 using std::shared_ptr;
 
+// Distancia t al rectangulo alineado a los ejes si el rayo lo corta dentro de ray_t.
+// normal_axis es el eje perpendicular al plano (0 = x, 1 = y, 2 = z) y
+// [a0,a1] x [b0,b1] son los limites en los otros dos ejes, en orden.
+inline bool axis_rect_t(int normal_axis, real a0, real a1, real b0, real b1, real k,
+                        const ray& r, interval ray_t, real& t) {
+    int a_axis = (normal_axis == 0) ? 1 : 0;
+    int b_axis = (normal_axis == 2) ? 1 : 2;
+
+    t = (k - r.origin()[normal_axis]) / r.direction()[normal_axis];
+    if (!ray_t.surrounds(t))
+        return false;
+
+    real a = r.origin()[a_axis] + t*r.direction()[a_axis];
+    real b = r.origin()[b_axis] + t*r.direction()[b_axis];
+
+    return !(a < a0 || a > a1 || b < b0 || b > b1);
+}
+
+// Interseccion con un rectangulo alineado a los ejes, sin el material
+inline bool hit_axis_rect(int normal_axis, real a0, real a1, real b0, real b1, real k,
+                          const ray& r, interval ray_t, hit_record& rec) {
+    real t;
+    if (!axis_rect_t(normal_axis, a0, a1, b0, b1, k, r, ray_t, t))
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+
+    vec3 outward_normal(0, 0, 0);
+    outward_normal[normal_axis] = 1;
+    rec.set_face_normal(r, outward_normal);
+    return true;
+}
+
+// Densidad por angulo solido de muestrear el rectangulo por area desde origin
+inline double axis_rect_pdf_value(int normal_axis, real a0, real a1, real b0, real b1, real k,
+                                  const point3& origin, const vec3& direction) {
+    hit_record rec;
+    if (!hit_axis_rect(normal_axis, a0, a1, b0, b1, k, ray(origin, direction), interval(hit_epsilon, infinity), rec))
+        return 0;
+
+    auto area = (a1 - a0) * (b1 - b0);
+    auto distance_squared = rec.t * rec.t * direction.length_squared();
+    auto cosine = std::fabs(direction[normal_axis]) / direction.length();
+    return distance_squared / (cosine * area);
+}
+
+// Direccion desde origin a un punto uniforme del rectangulo
+inline vec3 axis_rect_random(int normal_axis, real a0, real a1, real b0, real b1, real k, const point3& origin) {
+    int a_axis = (normal_axis == 0) ? 1 : 0;
+    int b_axis = (normal_axis == 2) ? 1 : 2;
+
+    point3 p;
+    p[normal_axis] = k;
+    p[a_axis] = random_double(a0, a1);
+    p[b_axis] = random_double(b0, b1);
+    return p - origin;
+}
+
 class xy_rect : public hittable {
 public:
-    double x0, x1;
-    double y0, y1;
-    double k;                 // Valor Z constante
+    real x0, x1;
+    real y0, y1;
+    real k;                 // Valor Z constante
     shared_ptr<material> mat;
 
     xy_rect() {}
 
-    xy_rect(double _x0, double _x1, double _y0, double _y1, double _k,
+    xy_rect(real _x0, real _x1, real _y0, real _y1, real _k,
             shared_ptr<material> m)
         : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mat(m) {}
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // t para intersecar el plano z = k
-        double t = (k - r.origin().z()) / r.direction().z();
-        if (!ray_t.surrounds(t))
+        if (!hit_axis_rect(2, x0, x1, y0, y1, k, r, ray_t, rec))
             return false;
+        rec.mat = mat.get();
+        return true;
+    }
 
-        double x = r.origin().x() + t*r.direction().x();
-        double y = r.origin().y() + t*r.direction().y();
+    virtual bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const override {
+        return axis_rect_t(2, x0, x1, y0, y1, k, r, ray_t, t);
+    }
 
-        if (x < x0 || x > x1 || y < y0 || y > y1)
-            return false;
+    virtual bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        return axis_rect_t(2, x0, x1, y0, y1, k, r, ray_t, t);
+    }
 
-        rec.t = t;
-        rec.p = r.at(t);
+    virtual aabb bounding_box() const override {
+        return aabb(point3(x0, y0, k), point3(x1, y1, k));
+    }
 
-        vec3 outward_normal(0, 0, 1);
-        rec.set_face_normal(r, outward_normal);
+    virtual double pdf_value(const point3& origin, const vec3& direction) const override {
+        return axis_rect_pdf_value(2, x0, x1, y0, y1, k, origin, direction);
+    }
 
-        rec.mat = mat;
-        return true;
+    virtual vec3 random(const point3& origin) const override {
+        return axis_rect_random(2, x0, x1, y0, y1, k, origin);
     }
 };
 
 
 class xz_rect : public hittable {
 public:
-    double x0, x1;
-    double z0, z1;
-    double k;                // Valor Y constante
+    real x0, x1;
+    real z0, z1;
+    real k;                // Valor Y constante
     shared_ptr<material> mat;
 
     xz_rect() {}
 
-    xz_rect(double _x0, double _x1, double _z0, double _z1, double _k,
+    xz_rect(real _x0, real _x1, real _z0, real _z1, real _k,
             shared_ptr<material> m)
         : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mat(m) {}
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // t para plano y = k
-        double t = (k - r.origin().y()) / r.direction().y();
-        if (!ray_t.surrounds(t))
+        if (!hit_axis_rect(1, x0, x1, z0, z1, k, r, ray_t, rec))
             return false;
+        rec.mat = mat.get();
+        return true;
+    }
 
-        double x = r.origin().x() + t*r.direction().x();
-        double z = r.origin().z() + t*r.direction().z();
+    virtual bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const override {
+        return axis_rect_t(1, x0, x1, z0, z1, k, r, ray_t, t);
+    }
 
-        if (x < x0 || x > x1 || z < z0 || z > z1)
-            return false;
+    virtual bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        return axis_rect_t(1, x0, x1, z0, z1, k, r, ray_t, t);
+    }
 
-        rec.t = t;
-        rec.p = r.at(t);
+    virtual aabb bounding_box() const override {
+        return aabb(point3(x0, k, z0), point3(x1, k, z1));
+    }
 
-        vec3 outward_normal(0, 1, 0);
-        rec.set_face_normal(r, outward_normal);
+    virtual double pdf_value(const point3& origin, const vec3& direction) const override {
+        return axis_rect_pdf_value(1, x0, x1, z0, z1, k, origin, direction);
+    }
 
-        rec.mat = mat;
-        return true;
+    virtual vec3 random(const point3& origin) const override {
+        return axis_rect_random(1, x0, x1, z0, z1, k, origin);
     }
 };
 
 class yz_rect : public hittable {
 public:
-    double y0, y1;
-    double z0, z1;
-    double k;                // Valor X constante
+    real y0, y1;
+    real z0, z1;
+    real k;                // Valor X constante
     shared_ptr<material> mat;
 
     yz_rect() {}
 
-    yz_rect(double _y0, double _y1, double _z0, double _z1, double _k,
+    yz_rect(real _y0, real _y1, real _z0, real _z1, real _k,
             shared_ptr<material> m)
         : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mat(m) {}
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // t para el plano x = k
-        double t = (k - r.origin().x()) / r.direction().x();
-        if (!ray_t.surrounds(t))
+        if (!hit_axis_rect(0, y0, y1, z0, z1, k, r, ray_t, rec))
             return false;
+        rec.mat = mat.get();
+        return true;
+    }
 
-        double y = r.origin().y() + t*r.direction().y();
-        double z = r.origin().z() + t*r.direction().z();
+    virtual bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const override {
+        return axis_rect_t(0, y0, y1, z0, z1, k, r, ray_t, t);
+    }
 
-        if (y < y0 || y > y1 || z < z0 || z > z1)
-            return false;
+    virtual bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        return axis_rect_t(0, y0, y1, z0, z1, k, r, ray_t, t);
+    }
 
-        rec.t = t;
-        rec.p = r.at(t);
+    virtual aabb bounding_box() const override {
+        return aabb(point3(k, y0, z0), point3(k, y1, z1));
+    }
 
-        vec3 outward_normal(1, 0, 0);
-        rec.set_face_normal(r, outward_normal);
+    virtual double pdf_value(const point3& origin, const vec3& direction) const override {
+        return axis_rect_pdf_value(0, y0, y1, z0, z1, k, origin, direction);
+    }
 
-        rec.mat = mat;
-        return true;
+    virtual vec3 random(const point3& origin) const override {
+        return axis_rect_random(0, y0, y1, z0, z1, k, origin);
     }
 };
 
-// Caja compuesta por 6 rectángulos axis-aligned
+// Prueba de losas contra una caja solida [lo, hi]: devuelve la t de entrada si cae
+// en ray_t y si no la de salida (rayo que empieza dentro). axis es el eje de la cara golpeada.
+inline bool box_slab_t(const point3& lo, const point3& hi, const ray& r, interval ray_t, real& t, int& axis) {
+    real t_near = -infinity, t_far = infinity;
+    int near_axis = 0, far_axis = 0;
+
+    for (int a = 0; a < 3; a++) {
+        real inv_dir = 1 / r.direction()[a];
+        real t0 = (lo[a] - r.origin()[a]) * inv_dir;
+        real t1 = (hi[a] - r.origin()[a]) * inv_dir;
+        if (inv_dir < 0) std::swap(t0, t1);
+
+        if (t0 > t_near) { t_near = t0; near_axis = a; }
+        if (t1 < t_far)  { t_far = t1;  far_axis = a; }
+        if (t_far < t_near)
+            return false;
+    }
+
+    if (ray_t.surrounds(t_near)) {
+        t = t_near;
+        axis = near_axis;
+        return true;
+    }
+    if (ray_t.surrounds(t_far)) {
+        t = t_far;
+        axis = far_axis;
+        return true;
+    }
+    return false;
+}
+
+// Interseccion con la caja, sin el material. La normal apunta hacia afuera de la cara golpeada.
+inline bool hit_box_slab(const point3& lo, const point3& hi, const ray& r, interval ray_t, hit_record& rec) {
+    real t;
+    int axis;
+    if (!box_slab_t(lo, hi, r, ray_t, t, axis))
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+
+    vec3 outward_normal(0, 0, 0);
+    outward_normal[axis] = (rec.p[axis] > (lo[axis] + hi[axis]) / 2) ? 1 : -1;
+    rec.set_face_normal(r, outward_normal);
+    return true;
+}
+
+// Caja alineada a los ejes, se intersecta con una sola prueba de losas
 class box : public hittable {
 public:
     point3 box_min;
     point3 box_max;
-    hittable_list sides;
+    shared_ptr<material> mat;
 
     box() {}
-    box(const point3& p0, const point3& p1, shared_ptr<material> mat)
-        : box_min(p0), box_max(p1)
-    {
-        // 6 caras
+    box(const point3& p0, const point3& p1, shared_ptr<material> m)
+        : box_min(std::fmin(p0.x(), p1.x()), std::fmin(p0.y(), p1.y()), std::fmin(p0.z(), p1.z())),
+          box_max(std::fmax(p0.x(), p1.x()), std::fmax(p0.y(), p1.y()), std::fmax(p0.z(), p1.z())),
+          mat(m) {}
+
+    virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!hit_box_slab(box_min, box_max, r, ray_t, rec))
+            return false;
+        rec.mat = mat.get();
+        return true;
+    }
+
+    virtual bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const override {
+        int axis;
+        return box_slab_t(box_min, box_max, r, ray_t, t, axis);
+    }
+
+    virtual bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        int axis;
+        return box_slab_t(box_min, box_max, r, ray_t, t, axis);
+    }
+
+    virtual aabb bounding_box() const override {
+        return aabb(box_min, box_max);
+    }
+
+    // Las 6 caras como rectangulos, para muestrear una caja emisora como luz
+    hittable_list faces() const {
+        const point3& p0 = box_min;
+        const point3& p1 = box_max;
+        hittable_list sides;
         sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mat)); // +Z
         sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mat)); // -Z
 
@@ -136,10 +289,7 @@ public:
 
         sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mat)); // +X
         sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mat)); // -X
-    }
-
-    virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        return sides.hit(r, ray_t, rec);
+        return sides;
     }
 };
 
@@ -9,9 +9,14 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_FAILURE_USERMSG
 #include "thirdparty/stb_image.h"
+#include "baked_texture.h"
 
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 class rtw_image {
   public:
@@ -25,21 +30,18 @@ class rtw_image {
         // parent, on so on, for six levels up. If the image was not loaded successfully,
         // width() and height() will return 0.
 
-        auto filename = std::string(image_filename);
-        auto imagedir = getenv("RTW_IMAGES");
-
-        // Buscar la imagen en todas partes.
-        if (imagedir && load(std::string(imagedir) + "/" + image_filename)) return;
-        if (load(filename)) return;
-        if (load("images/" + filename)) return;
-        if (load("../images/" + filename)) return;
-        if (load("../../images/" + filename)) return;
-        if (load("../../../images/" + filename)) return;
-        if (load("../../../../images/" + filename)) return;
-        if (load("../../../../../images/" + filename)) return;
-        if (load("../../../../../../images/" + filename)) return;
+        auto path = resolve(image_filename);
+        if (path.empty() || !load(path))
+            std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
+    }
 
-        std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
+    // Imagen ya decodificada: rgb tiene width*height pixeles de 3 bytes, fila por fila
+    rtw_image(int width, int height, const unsigned char* rgb) : image_width(width), image_height(height) {
+        bytes_per_scanline = image_width * bytes_per_pixel;
+        size_t total_bytes = size_t(image_width) * image_height * bytes_per_pixel;
+        bdata = new unsigned char[total_bytes];
+        std::memcpy(bdata, rgb, total_bytes);
+        level0 = bdata;
     }
 
     ~rtw_image() {
@@ -47,6 +49,36 @@ class rtw_image {
         STBI_FREE(fdata);
     }
 
+    rtw_image(const rtw_image&) = delete;
+    rtw_image& operator=(const rtw_image&) = delete;
+
+    // Ruta donde el constructor encontraria la imagen, o vacio si no existe. Solo lee
+    // el encabezado, asi el cache de texturas puede usar la ruta como llave sin decodificar.
+    static std::string resolve(const char* image_filename) {
+        auto filename = std::string(image_filename);
+        auto imagedir = getenv("RTW_IMAGES");
+        auto usable = [](const std::string& path) {
+            int x, y, n;
+            return stbi_info(path.c_str(), &x, &y, &n) || baked_texture::is_baked(path);
+        };
+
+        // Buscar la imagen en todas partes.
+        if (imagedir) {
+            auto path = std::string(imagedir) + "/" + filename;
+            if (usable(path)) return path;
+        }
+        std::string prefix = "";
+        if (usable(filename)) return filename;
+        for (int level = 0; level < 7; level++) {
+            auto path = prefix + "images/" + filename;
+            if (usable(path)) return path;
+            prefix += "../";
+        }
+        return std::string();
+    }
+
+
+    // Carga la imagen de una ruta ya resuelta (ver resolve), sin buscarla
     bool load(const std::string& filename) {
         // Loads the linear (gamma=1) image data from the given file name. Returns true if the
         // load succeeded. The resulting data buffer contains the three [0.0, 1.0]
@@ -54,37 +86,229 @@ class rtw_image {
         // contiguous, going left to right for the width of the image, followed by the next row
         // below, for the full height of the image.
 
+        // Las texturas pre-horneadas se mapean (o se leen por bloques si hay tope de
+        // memoria para texturas), las demas se decodifican con stb_image
+        if (baked_texture::is_baked(filename))
+            return (tile_cache::budget() > 0) ? load_streamed(filename) : load_baked(filename);
+
         auto n = bytes_per_pixel; // Dummy out parameter: original components per pixel
         fdata = stbi_loadf(filename.c_str(), &image_width, &image_height, &n, bytes_per_pixel);
         if (fdata == nullptr) return false;
 
         bytes_per_scanline = image_width * bytes_per_pixel;
         convert_to_bytes();
+        level0 = bdata;
+
+        // Solo se muestrea la copia en bytes, la de float ocupa 4 veces mas
+        STBI_FREE(fdata);
+        fdata = nullptr;
+        return true;
+    }
+
+    // Textura .rtt (ver baked_texture.h): se mapea el archivo y el nivel 0 y los
+    // mipmaps apuntan directo a el, sin copiar ni convertir nada
+    bool load_baked(const std::string& filename) {
+        if (!mapping.open(filename) || mapping.size() < sizeof(baked_texture::header))
+            return baked_error(filename);
+
+        baked_texture::header h;
+        std::memcpy(&h, mapping.data(), sizeof(h));
+        if (!baked_texture::valid_header(h, mapping.size()))
+            return baked_error(filename);
+
+        image_width = int(h.level[0].width);
+        image_height = int(h.level[0].height);
+        bytes_per_scanline = image_width * bytes_per_pixel;
+        level0 = mapping.data() + h.level[0].offset;
+        for (uint32_t level = 1; level < h.levels; level++) {
+            const baked_texture::level_entry& e = h.level[level];
+            mips.push_back({ int(e.width), int(e.height), {}, mapping.data() + e.offset });
+        }
+        return true;
+    }
+
+    // Textura .rtt leida por bloques a traves de tile_cache (ver baked_stream). Los
+    // mipmaps ya vienen en el archivo; aqui solo se anotan sus tamanos.
+    bool load_streamed(const std::string& filename) {
+        auto opened = std::make_unique<baked_stream>();
+        if (!opened->open(filename))
+            return baked_error(filename);
+
+        stream = std::move(opened);
+        image_width = stream->width(0);
+        image_height = stream->height(0);
+        bytes_per_scanline = image_width * bytes_per_pixel;
+        for (int level = 1; level < stream->levels(); level++)
+            mips.push_back({ stream->width(level), stream->height(level), {}, nullptr });
         return true;
     }
 
-    int width()  const { return (fdata == nullptr) ? 0 : image_width; }
-    int height() const { return (fdata == nullptr) ? 0 : image_height; }
+    int width()  const { return has_pixels() ? image_width : 0; }
+    int height() const { return has_pixels() ? image_height : 0; }
+
+    // Memoria de pixeles que ocupa la imagen cargada, con sus mipmaps. Un archivo
+    // mapeado cuenta entero aunque el sistema solo cargue las paginas que se tocan.
+    size_t resident_bytes() const {
+        size_t total = (bdata == nullptr) ? 0 : size_t(image_width) * image_height * bytes_per_pixel;
+        total += mapping.size();
+        for (const auto& level : mips)
+            total += level.data.size();
+        for (const auto& level : tiles)
+            total += level.storage.size();
+        return total;
+    }
+
+    // Piramide de mipmaps: cada nivel promedia bloques de 2x2 del anterior hasta
+    // llegar a 1x1. El nivel 0 es la imagen original. Se llama una vez al cargar.
+    void build_mipmaps() {
+        if (!has_pixels() || !mips.empty()) return;
+
+        int w = image_width, h = image_height;
+        for (int level = 1; w > 1 || h > 1; level++) {
+            mip_level next;
+            next.width  = (w > 1) ? w / 2 : 1;
+            next.height = (h > 1) ? h / 2 : 1;
+            next.data.resize(size_t(next.width) * next.height * bytes_per_pixel);
+            next.pixels = next.data.data();
+
+            for (int y = 0; y < next.height; y++) {
+                for (int x = 0; x < next.width; x++) {
+                    const unsigned char* p00 = pixel_data(level - 1, 2*x,     2*y);
+                    const unsigned char* p10 = pixel_data(level - 1, 2*x + 1, 2*y);
+                    const unsigned char* p01 = pixel_data(level - 1, 2*x,     2*y + 1);
+                    const unsigned char* p11 = pixel_data(level - 1, 2*x + 1, 2*y + 1);
+                    unsigned char* out = &next.data[(size_t(y) * next.width + x) * bytes_per_pixel];
+                    for (int c = 0; c < bytes_per_pixel; c++)
+                        out[c] = static_cast<unsigned char>((p00[c] + p10[c] + p01[c] + p11[c] + 2) / 4);
+                }
+            }
+
+            w = next.width;
+            h = next.height;
+            mips.push_back(std::move(next));
+        }
+    }
+
+    // Niveles disponibles, 1 si no hay mipmaps
+    int levels() const { return 1 + int(mips.size()); }
+
+    int width(int level)  const { return (level == 0) ? width()  : mips[level - 1].width; }
+    int height(int level) const { return (level == 0) ? height() : mips[level - 1].height; }
+
+    // Como pixel_data(x, y) pero en un nivel de la piramide
+    const unsigned char* pixel_data(int level, int x, int y) const {
+        if (stream) return stream->pixel_data(level, clamp(x, 0, width(level)), clamp(y, 0, height(level)));
+        if (level < int(tiles.size())) return tiled_pixel(tiles[level], x, y);
+        if (level == 0) return pixel_data(x, y);
+
+        const mip_level& m = mips[level - 1];
+        x = clamp(x, 0, m.width);
+        y = clamp(y, 0, m.height);
+        return m.pixels + (size_t(y) * m.width + x) * bytes_per_pixel;
+    }
+
+    // Pasa todos los niveles (los que aun no lo esten) a bloques de 4x4 pixeles de 4
+    // bytes, RGB y uno de relleno. Cada bloque mide 64 bytes y empieza en una linea
+    // de cache, asi los vecinos en x y en y de un pixel casi siempre estan en la misma
+    // linea; en fila por fila el vecino de abajo esta una fila entera mas adelante.
+    // Las copias fila por fila se liberan. Se llama al cargar la escena.
+    void use_tiled_layout() {
+        if (stream) return;  // Ya se lee en bloques de tile_cache
+
+        for (int level = int(tiles.size()); level < levels() && has_pixels(); level++) {
+            tiled_level t;
+            t.width = width(level);
+            t.height = height(level);
+            t.tiles_x = (t.width + tile_size - 1) / tile_size;
+            int tiles_y = (t.height + tile_size - 1) / tile_size;
+            t.storage.assign(size_t(t.tiles_x) * tiles_y * tile_bytes + tile_bytes, 0);
+
+            // El bloque 0 queda alineado a 64 bytes dentro del buffer
+            auto address = reinterpret_cast<std::uintptr_t>(t.storage.data());
+            t.data = t.storage.data() + (tile_bytes - address % tile_bytes) % tile_bytes;
+
+            for (int y = 0; y < t.height; y++) {
+                for (int x = 0; x < t.width; x++) {
+                    const unsigned char* src = pixel_data(level, x, y);
+                    unsigned char* dst = const_cast<unsigned char*>(tiled_pixel(t, x, y));
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                }
+            }
+            tiles.push_back(std::move(t));
+        }
+
+        delete[] bdata;
+        bdata = nullptr;
+        level0 = nullptr;
+        for (auto& m : mips) {
+            m.data.clear();
+            m.data.shrink_to_fit();
+            m.pixels = nullptr;
+        }
+        mapping.close();
+    }
+
+    bool is_tiled() const { return !tiles.empty(); }
 
     const unsigned char* pixel_data(int x, int y) const {
         // Return the address of the three RGB bytes of the pixel at x,y. If there is no image
         // data, returns magenta.
         static unsigned char magenta[] = { 255, 0, 255 };
-        if (bdata == nullptr) return magenta;
+        if (stream) return pixel_data(0, x, y);
+        if (!tiles.empty()) return tiled_pixel(tiles[0], x, y);
+        if (level0 == nullptr) return magenta;
 
         x = clamp(x, 0, image_width);
         y = clamp(y, 0, image_height);
 
-        return bdata + y*bytes_per_scanline + x*bytes_per_pixel;
+        return level0 + y*bytes_per_scanline + x*bytes_per_pixel;
     }
 
   private:
+    struct mip_level {
+        int width, height;
+        std::vector<unsigned char> data;  // Vacio si el nivel viene de un archivo mapeado
+        const unsigned char* pixels;      // data.data() o dentro del mapeo
+    };
+
+    static const int tile_size = 4;                       // Pixeles por lado de un bloque
+    static const int tile_bytes = tile_size*tile_size*4;  // 64, una linea de cache
+
+    struct tiled_level {
+        int width, height, tiles_x;
+        std::vector<unsigned char> storage;
+        unsigned char* data;  // Primer bloque, alineado a 64 bytes dentro de storage
+    };
+
     const int      bytes_per_pixel = 3;
     float         *fdata = nullptr;         // Linear floating point pixel data
     unsigned char *bdata = nullptr;         // Linear 8-bit pixel data
+    const unsigned char *level0 = nullptr;  // Pixeles del nivel 0: bdata o dentro del mapeo
+    mapped_file    mapping;                 // Archivo .rtt mapeado, si la imagen viene de uno
+    std::unique_ptr<baked_stream> stream;   // Archivo .rtt leido por bloques, en vez del mapeo
     int            image_width = 0;         // Loaded image width
     int            image_height = 0;        // Loaded image height
     int            bytes_per_scanline = 0;
+    std::vector<mip_level> mips;            // Niveles 1 en adelante
+    std::vector<tiled_level> tiles;         // Niveles ya pasados a bloques, desde el 0
+
+    bool has_pixels() const { return level0 != nullptr || !tiles.empty() || stream != nullptr; }
+
+    bool baked_error(const std::string& filename) {
+        std::cerr << "ERROR: Invalid baked texture '" << filename << "'.\n";
+        mapping.close();
+        return false;
+    }
+
+    static const unsigned char* tiled_pixel(const tiled_level& t, int x, int y) {
+        // Con coordenadas sin signo las divisiones entre 4 son corrimientos
+        unsigned ux = unsigned(clamp(x, 0, t.width));
+        unsigned uy = unsigned(clamp(y, 0, t.height));
+        size_t tile = size_t(uy / tile_size) * t.tiles_x + ux / tile_size;
+        return t.data + tile * tile_bytes + ((uy % tile_size) * tile_size + ux % tile_size) * 4;
+    }
 
     static int clamp(int x, int low, int high) {
         // Return the value clamped to the range [low, high).
@@ -2,7 +2,7 @@
 #define RTWEEKEND_H
 
 #include <cmath>
-#include <random>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -11,21 +11,89 @@
 using std::make_shared;
 using std::shared_ptr;
 
+// Tipo escalar de la geometria (vec3, ray, interval, Matrix4...).
+// Compilando con RT_SINGLE_PRECISION todo el camino de interseccion usa float.
+#ifdef RT_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constantes
 
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi = acos(-1);
+const real infinity = std::numeric_limits<real>::infinity();
+const real pi = real(acos(-1.0));
+
+// Distancia minima de un golpe, evita que un rayo vuelva a chocar con la superficie de la que sale.
+// En float el error de redondeo es mayor, asi que el margen tambien.
+#ifdef RT_SINGLE_PRECISION
+const real hit_epsilon = 2e-3f;
+const real near_zero_epsilon = 1e-6f;
+#else
+const real hit_epsilon = 0.001;
+const real near_zero_epsilon = 1e-8;
+#endif
 
 // Funciones comunes
 
-inline double degrees_to_radians(double degrees) {
-    return degrees * pi / 180.0;
+inline real degrees_to_radians(real degrees) {
+    return degrees * pi / real(180.0);
+}
+
+// Generador PCG32 (O'Neill, pcg-random.org). Es mucho mas ligero que mt19937
+// (16 bytes de estado) y permite elegir la secuencia con (estado, stream).
+class pcg32 {
+  public:
+    pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+
+    void seed(uint64_t initstate, uint64_t initseq) {
+        state = 0;
+        inc = (initseq << 1u) | 1u;
+        next_uint();
+        state += initstate;
+        next_uint();
+    }
+
+    uint32_t next_uint() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31u));
+    }
+
+    // Uniforme en [0,1)
+    double next_double() {
+        return next_uint() * (1.0 / 4294967296.0);
+    }
+
+  private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+// Mezcla de bits de splitmix64, para que indices consecutivos den estados sin relacion
+inline uint64_t mix_bits(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Cada hilo tiene su propio generador para que el render en paralelo no tenga carreras
+inline pcg32& random_generator() {
+    thread_local pcg32 generator;
+    return generator;
+}
+
+// Deja el generador del hilo en una secuencia que solo depende de (semilla, pixel, muestra),
+// asi el render es reproducible sin importar el orden en que los hilos tomen el trabajo.
+inline void seed_random(uint64_t seed, uint64_t pixel, uint64_t sample) {
+    random_generator().seed(mix_bits(pixel ^ mix_bits(sample)), seed);
 }
 
 inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return random_generator().next_double();
 }
 
 inline double random_double(double min, double max){
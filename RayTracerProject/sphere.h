@@ -2,47 +2,149 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "onb.h"
 #include "vec3.h"
 
 class sphere : public hittable {
   public:
-    sphere(const point3& center, double radius, shared_ptr<material> mat) : center(center), radius(std::fmax(0,radius)), mat(mat) {}
+    sphere(const point3& center, real radius, shared_ptr<material> mat) : center(center), radius(std::fmax(0,radius)), mat(mat) {
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!intersect(center, radius, r, ray_t, rec))
+            return false;
+        rec.mat = mat.get();
+        return true;
+    }
+
+    bool hit_distance(const ray& r, interval ray_t, real& t, hit_path&) const override {
+        return find_root(center, radius, r, ray_t, t);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        real root;
+        return find_root(center, radius, r, ray_t, root);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // Se muestrea el cono de direcciones que ve la esfera desde origin
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        // Desde dentro random() elige cualquier direccion, todas tocan la esfera
+        auto dist_squared = (center - origin).length_squared();
+        if (dist_squared <= radius*radius)
+            return 1 / (4*pi);
+
+        hit_record rec;
+        if (!intersect(center, radius, ray(origin, direction), interval(hit_epsilon, infinity), rec))
+            return 0;
+
+        auto cos_theta_max = std::sqrt(1 - radius*radius/dist_squared);
+        auto solid_angle = 2*pi*(1 - cos_theta_max);
+        return 1 / solid_angle;
+    }
+
+    vec3 random(const point3& origin) const override {
+        vec3 direction = center - origin;
+        auto dist_squared = direction.length_squared();
+        if (dist_squared <= radius*radius)
+            return random_unit_vector();
+
+        onb uvw(direction);
+        return uvw.transform(random_to_sphere(radius, dist_squared));
+    }
+
+    const point3& get_center() const { return center; }
+    real get_radius() const { return radius; }
+    const shared_ptr<material>& get_material() const { return mat; }
+
+    // Interseccion sin el material, la comparten sphere::hit y el BVH lineal
+    static bool intersect(const point3& center, real radius, const ray& r, interval ray_t, hit_record& rec) {
+        real root;
+        if (!find_root(center, radius, r, ray_t, root))
+            return false;
+
+        rec.t = root;
+        rec.p = r.at(rec.t);
+				vec3 outward_normal = (rec.p - center) / radius;
+        rec.set_face_normal(r, outward_normal);
+				get_sphere_uv(outward_normal, rec.u, rec.v);
+        // u da la vuelta en 2 pi r y v en pi r, usamos su media geometrica
+        rec.uv_density = 1 / (pi * std::sqrt(2.0) * std::fabs(radius));
+
+        return true;
+    }
+
+    // Raiz mas cercana dentro de ray_t, sin atributos del golpe
+    static bool find_root(const point3& center, real radius, const ray& r, interval ray_t, real& root) {
         vec3 oc = center - r.origin();
         auto a = r.direction().length_squared();
         auto h = dot(r.direction(), oc);
         auto c = oc.length_squared() - radius*radius;
 
+#ifdef RT_SINGLE_PRECISION
+        // En float h*h - a*c pierde casi todos los digitos con esferas grandes (el suelo
+        // tiene radio 1000). Usamos la forma estable de Ray Tracing Gems, cap. 7:
+        // el discriminante con la distancia del centro a la recta, y las raices con q.
+        vec3 l = oc - (h / a) * r.direction();
+        auto discriminant = a * (radius*radius - l.length_squared());
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        auto q = h + std::copysign(sqrtd, h);
+        if (q == 0)
+            return false;
+        auto root_near = c / q;
+        auto root_far = q / a;
+        if (root_near > root_far) std::swap(root_near, root_far);
+
+        root = root_near;
+        if (!ray_t.surrounds(root)) {
+            root = root_far;
+            if (!ray_t.surrounds(root))
+                return false;
+        }
+#else
         auto discriminant = h*h - a*c;
         if (discriminant < 0)
             return false;
 
         auto sqrtd = std::sqrt(discriminant);
 
-        auto root = (h - sqrtd) / a;
+        root = (h - sqrtd) / a;
          if (!ray_t.surrounds(root)) {
             root = (h + sqrtd) / a;
             if (!ray_t.surrounds(root))
                 return false;
         }
-
-        rec.t = root;
-        rec.p = r.at(rec.t);
-				vec3 outward_normal = (rec.p - center) / radius;
-        rec.set_face_normal(r, outward_normal);
-				get_sphere_uv(outward_normal, rec.u, rec.v);
-				rec.mat = mat;
+#endif
 
         return true;
     }
 
   private:
     point3 center;
-    double radius;
+    real radius;
 		shared_ptr<material> mat;
+    aabb bbox;
+
+    // Direccion uniforme dentro del cono que subtiende la esfera, con eje en z
+    static vec3 random_to_sphere(real radius, real dist_squared) {
+        auto r1 = random_double();
+        auto r2 = random_double();
+        auto z = 1 + r2*(std::sqrt(1 - radius*radius/dist_squared) - 1);
+
+        auto phi = 2*pi*r1;
+        auto x = std::cos(phi) * std::sqrt(1 - z*z);
+        auto y = std::sin(phi) * std::sqrt(1 - z*z);
+
+        return vec3(x, y, z);
+    }
 
-		static void get_sphere_uv(const point3& p, double& u, double& v) {
+		static void get_sphere_uv(const point3& p, real& u, real& v) {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
         // v: returned value [0,1] of angle from Y=-1 to Y=+1.
@@ -0,0 +1,219 @@
+#ifndef SPHERE_SIMD_H
+#define SPHERE_SIMD_H
+
+#include "hittable.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define RT_SPHERE_SSE2
+#endif
+
+// Datos de una esfera para rellenar el hit_record del golpe ganador
+struct sphere_data {
+    point3 center;
+    double radius;
+    const material* mat;
+};
+
+// Esferas agrupadas en paquetes de 4 con los datos por componente (x de las 4,
+// luego y de las 4...), asi un rayo se prueba contra 4 esferas con una sola
+// instruccion AVX (o dos SSE2). Sin SIMD se usa el mismo calculo escalar.
+class sphere_set {
+  public:
+    static const int width = 4;
+
+    struct alignas(32) packet {
+        double cx[width], cy[width], cz[width];
+        double r2[width];  // Radio al cuadrado, -inf en carriles vacios
+    };
+
+    // Agrega un paquete con hasta 4 esferas y devuelve su indice
+    uint32_t add_packet(const sphere_data* spheres, int count) {
+        packet p;
+        for (int lane = 0; lane < width; lane++) {
+            bool used = lane < count;
+            sphere_data s = used ? spheres[lane] : sphere_data{point3(0,0,0), 0, nullptr};
+            p.cx[lane] = s.center.x();
+            p.cy[lane] = s.center.y();
+            p.cz[lane] = s.center.z();
+            p.r2[lane] = used ? s.radius*s.radius : -infinity;
+            lanes.push_back(s);
+        }
+        packets.push_back(p);
+        return uint32_t(packets.size() - 1);
+    }
+
+    size_t size() const { return packets.size(); }
+
+    bool hit(uint32_t index, const ray& r, interval ray_t, hit_record& rec) const {
+        int lane = nearest_lane(packets[index], r, ray_t);
+        if (lane < 0)
+            return false;
+
+        // El golpe completo (punto, normal, uv) se calcula solo para la esfera ganadora
+        const sphere_data& s = lanes[index * width + lane];
+        if (!sphere::intersect(s.center, s.radius, r, ray_t, rec))
+            return hit_scalar(index, r, ray_t, rec);
+        rec.mat = s.mat;
+        return true;
+    }
+
+    // Solo la distancia, con la misma eleccion de esfera que hit()
+    bool hit_distance(uint32_t index, const ray& r, interval ray_t, real& t) const {
+        int lane = nearest_lane(packets[index], r, ray_t);
+        if (lane < 0)
+            return false;
+
+        const sphere_data& s = lanes[index * width + lane];
+        if (sphere::find_root(s.center, s.radius, r, ray_t, t))
+            return true;
+
+        bool hit_anything = false;
+        for (lane = 0; lane < width; lane++) {
+            const sphere_data& other = lanes[index * width + lane];
+            real root;
+            if (other.mat && sphere::find_root(other.center, other.radius, r, ray_t, root)) {
+                t = ray_t.max = root;
+                hit_anything = true;
+            }
+        }
+        return hit_anything;
+    }
+
+    // Alguna de las 4 esferas corta el rayo dentro de ray_t
+    bool occluded(uint32_t index, const ray& r, interval ray_t) const {
+        return nearest_lane(packets[index], r, ray_t) >= 0;
+    }
+
+    // Version escalar, prueba esfera por esfera como sphere::hit
+    bool hit_scalar(uint32_t index, const ray& r, interval ray_t, hit_record& rec) const {
+        bool hit_anything = false;
+        for (int lane = 0; lane < width; lane++) {
+            const sphere_data& s = lanes[index * width + lane];
+            if (s.mat && sphere::intersect(s.center, s.radius, r, ray_t, rec)) {
+                rec.mat = s.mat;
+                ray_t.max = rec.t;
+                hit_anything = true;
+            }
+        }
+        return hit_anything;
+    }
+
+    // Devuelve el carril con la raiz valida mas cercana, o -1 si ninguno
+    static int nearest_lane(const packet& p, const ray& r, interval ray_t) {
+        alignas(32) double t[width];
+        const point3& o = r.origin();
+        const vec3& d = r.direction();
+        double a = d.length_squared();
+
+        // Las raices se comparan multiplicadas por a (t*a = h -+ sqrt(disc)) para no
+        // dividir; a > 0 asi que el orden no cambia. El golpe exacto lo calcula hit().
+        double amin = a * ray_t.min;
+        double amax = a * ray_t.max;
+
+#if defined(__AVX__)
+        __m256d ocx = _mm256_sub_pd(_mm256_load_pd(p.cx), _mm256_set1_pd(o.x()));
+        __m256d ocy = _mm256_sub_pd(_mm256_load_pd(p.cy), _mm256_set1_pd(o.y()));
+        __m256d ocz = _mm256_sub_pd(_mm256_load_pd(p.cz), _mm256_set1_pd(o.z()));
+        __m256d dx = _mm256_set1_pd(d.x()), dy = _mm256_set1_pd(d.y()), dz = _mm256_set1_pd(d.z());
+
+        __m256d h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)), _mm256_mul_pd(dz, ocz));
+        __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+        __m256d c = _mm256_sub_pd(len2, _mm256_load_pd(p.r2));
+        __m256d disc = _mm256_sub_pd(_mm256_mul_pd(h, h), _mm256_mul_pd(_mm256_set1_pd(a), c));
+        __m256d has_root = _mm256_cmp_pd(disc, _mm256_setzero_pd(), _CMP_GE_OQ);
+
+        // Caso comun: el rayo no toca ninguna de las 4
+        if (_mm256_movemask_pd(has_root) == 0)
+            return -1;
+
+        __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(disc, _mm256_setzero_pd()));
+        __m256d t0 = _mm256_sub_pd(h, sqrtd);
+        __m256d t1 = _mm256_add_pd(h, sqrtd);
+
+        __m256d tmin = _mm256_set1_pd(amin), tmax = _mm256_set1_pd(amax);
+        __m256d in0 = _mm256_and_pd(_mm256_cmp_pd(t0, tmin, _CMP_GT_OQ), _mm256_cmp_pd(t0, tmax, _CMP_LT_OQ));
+        __m256d in1 = _mm256_and_pd(_mm256_cmp_pd(t1, tmin, _CMP_GT_OQ), _mm256_cmp_pd(t1, tmax, _CMP_LT_OQ));
+
+        __m256d res = _mm256_blendv_pd(_mm256_set1_pd(infinity), t1, in1);
+        res = _mm256_blendv_pd(res, t0, in0);
+        res = _mm256_blendv_pd(_mm256_set1_pd(infinity), res, has_root);
+        _mm256_store_pd(t, res);
+#elif defined(RT_SPHERE_SSE2)
+        __m128d dx = _mm_set1_pd(d.x()), dy = _mm_set1_pd(d.y()), dz = _mm_set1_pd(d.z());
+        __m128d h[2], disc[2];
+        int any_root = 0;
+        for (int half = 0; half < 2; half++) {
+            __m128d ocx = _mm_sub_pd(_mm_load_pd(p.cx + 2*half), _mm_set1_pd(o.x()));
+            __m128d ocy = _mm_sub_pd(_mm_load_pd(p.cy + 2*half), _mm_set1_pd(o.y()));
+            __m128d ocz = _mm_sub_pd(_mm_load_pd(p.cz + 2*half), _mm_set1_pd(o.z()));
+
+            h[half] = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ocx), _mm_mul_pd(dy, ocy)), _mm_mul_pd(dz, ocz));
+            __m128d len2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+            __m128d c = _mm_sub_pd(len2, _mm_load_pd(p.r2 + 2*half));
+            disc[half] = _mm_sub_pd(_mm_mul_pd(h[half], h[half]), _mm_mul_pd(_mm_set1_pd(a), c));
+            any_root |= _mm_movemask_pd(_mm_cmpge_pd(disc[half], _mm_setzero_pd()));
+        }
+
+        // Caso comun: el rayo no toca ninguna de las 4
+        if (any_root == 0)
+            return -1;
+
+        for (int half = 0; half < 2; half++) {
+            __m128d has_root = _mm_cmpge_pd(disc[half], _mm_setzero_pd());
+            __m128d sqrtd = _mm_sqrt_pd(_mm_max_pd(disc[half], _mm_setzero_pd()));
+            __m128d t0 = _mm_sub_pd(h[half], sqrtd);
+            __m128d t1 = _mm_add_pd(h[half], sqrtd);
+
+            __m128d tmin = _mm_set1_pd(amin), tmax = _mm_set1_pd(amax);
+            __m128d in0 = _mm_and_pd(_mm_cmpgt_pd(t0, tmin), _mm_cmplt_pd(t0, tmax));
+            __m128d in1 = _mm_and_pd(_mm_cmpgt_pd(t1, tmin), _mm_cmplt_pd(t1, tmax));
+
+            // Sin blendv en SSE2: seleccion con and/andnot
+            __m128d inf = _mm_set1_pd(infinity);
+            __m128d res = _mm_or_pd(_mm_and_pd(in1, t1), _mm_andnot_pd(in1, inf));
+            res = _mm_or_pd(_mm_and_pd(in0, t0), _mm_andnot_pd(in0, res));
+            res = _mm_or_pd(_mm_and_pd(has_root, res), _mm_andnot_pd(has_root, inf));
+            _mm_store_pd(t + 2*half, res);
+        }
+#else
+        for (int lane = 0; lane < width; lane++) {
+            vec3 oc(p.cx[lane] - o.x(), p.cy[lane] - o.y(), p.cz[lane] - o.z());
+            double h = dot(d, oc);
+            double c = oc.length_squared() - p.r2[lane];
+            double disc = h*h - a*c;
+            t[lane] = infinity;
+            if (disc < 0) continue;
+            double sqrtd = std::sqrt(disc);
+            double root = h - sqrtd;
+            if (!(amin < root && root < amax)) {
+                root = h + sqrtd;
+                if (!(amin < root && root < amax)) continue;
+            }
+            t[lane] = root;
+        }
+#endif
+
+        int best = -1;
+        double best_t = infinity;
+        for (int lane = 0; lane < width; lane++) {
+            if (t[lane] < best_t) {
+                best_t = t[lane];
+                best = lane;
+            }
+        }
+        return best;
+    }
+
+  private:
+    std::vector<packet> packets;
+    std::vector<sphere_data> lanes;
+};
+
+#endif
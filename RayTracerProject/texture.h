@@ -2,11 +2,23 @@
 #define TEXTURE_H
 #include "rtw_stb_image.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
 class texture {
   public:
     virtual ~texture() = default;
 
     virtual color value(double u, double v, const point3& p) const = 0;
+
+    // Valor promediado sobre un area de ancho footprint en uv (0 = un punto). Por
+    // defecto es value(), las texturas de imagen lo usan para filtrar.
+    virtual color filtered_value(double u, double v, const point3& p, double footprint) const {
+        return value(u, v, p);
+    }
 };
 
 class solid_color : public texture {
@@ -23,11 +35,112 @@ class solid_color : public texture {
     color albedo;
 };
 
+// Cache de imagenes para todo el proceso: cada archivo (por su ruta ya resuelta) se
+// decodifica una sola vez por distribucion en memoria (fila por fila o en bloques) y
+// las texturas comparten la misma imagen, que no cambia.
+// Al cargar la escena las texturas solo anotan el archivo con request(); la imagen se
+// lee con get() la primera vez que un rayo la muestrea, asi las que nadie ve no se cargan.
+class image_cache {
+  public:
+    // Llave de una imagen: ruta resuelta y si va en bloques. La distribucion es parte de
+    // la llave para que pedir "tiled" en un objeto no cambie la de los demas.
+    using key_type = std::pair<std::string, bool>;
+
+    // Anota que una textura usara el archivo, con o sin mipmaps y en bloques o no, y
+    // devuelve la llave para get(). Todas las texturas lo llaman antes del render, asi
+    // la imagen se carga una vez con los mipmaps si alguna los pide y despues nadie la
+    // modifica. Los mipmaps no cambian lo que leen las texturas que no los usan.
+    static key_type request(const char* filename, bool mipmaps = false, bool tiled = false) {
+        image_cache& cache = instance();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        // Si no se encuentra la llave es el nombre tal cual, asi se avisa una sola vez
+        std::string path = rtw_image::resolve(filename);
+        if (path.empty()) path = filename;
+
+        key_type key(path, tiled);
+        if (cache.images.count(key)) cache.hits++;
+        entry& e = cache.images[key];
+        e.mipmaps = e.mipmaps || mipmaps;
+        return key;
+    }
+
+    // La imagen de la llave, cargada la primera vez. Puede llamarse desde varios hilos;
+    // cada imagen se decodifica sin el mutex, asi otras se pueden cargar a la vez.
+    static std::shared_ptr<const rtw_image> get(const key_type& key) {
+        image_cache& cache = instance();
+        entry* e;
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            e = &cache.images[key];  // Los nodos del map no se mueven
+        }
+
+        std::call_once(e->loaded, [&] {
+            // La ruta ya esta resuelta: se carga tal cual, sin volver a buscarla
+            auto image = std::make_shared<rtw_image>();
+            if (!image->load(key.first))
+                std::cerr << "ERROR: Could not load image file '" << key.first << "'.\n";
+            if (e->mipmaps) image->build_mipmaps();
+            if (key.second) image->use_tiled_layout();
+
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            cache.resident += image->resident_bytes();
+            cache.loaded++;
+            e->image = image;
+        });
+        return e->image;
+    }
+
+    // Imprime cuantas imagenes hay y cuantas se usaron, cuantas veces se reutilizaron
+    // y cuanta memoria ocupan. Va despues del render, cuando ya se cargaron.
+    static void report() {
+        image_cache& cache = instance();
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            if (cache.images.empty()) return;
+            std::clog << "Texturas: " << cache.images.size() << " imagenes (" << cache.loaded << " usadas), "
+                      << cache.hits << " reutilizadas, " << cache.resident / (1024.0 * 1024.0) << " MB\n";
+        }
+        tile_cache::report();
+    }
+
+  private:
+    struct entry {
+        bool mipmaps = false;
+        std::once_flag loaded;
+        std::shared_ptr<rtw_image> image;
+    };
+
+    std::map<key_type, entry> images;
+    std::mutex mutex;
+    size_t hits = 0;
+    size_t loaded = 0;
+    size_t resident = 0;
+
+    static image_cache& instance() {
+        static image_cache cache;
+        return cache;
+    }
+};
+
+// Como se lee la imagen: el texel mas cercano, interpolacion bilineal entre 4 texels,
+// o trilineal entre dos niveles de mipmap elegidos segun el tamano del pixel en la superficie
+enum class texture_filter { nearest, bilinear, trilinear };
+
 class image_texture : public texture {
   public:
-    image_texture(const char* filename) : image(filename) {}
+    // Con tiled la imagen se guarda en bloques de 4x4 (ver rtw_image::use_tiled_layout).
+    // El archivo se lee en el primer muestreo, no aqui (ver image_cache).
+    image_texture(const char* filename, texture_filter filter = texture_filter::nearest, bool tiled = false)
+      : key(image_cache::request(filename, filter == texture_filter::trilinear, tiled)), filter(filter) {}
 
     color value(double u, double v, const point3& p) const override {
+        return filtered_value(u, v, p, 0);
+    }
+
+    color filtered_value(double u, double v, const point3& p, double footprint) const override {
+        const rtw_image& image = loaded_image();
+
         // Colos base por si no se encuentra la imagen
         if (image.height() <= 0) return color(0,1,1);
 
@@ -35,16 +148,54 @@ class image_texture : public texture {
         u = interval(0,1).clamp(u);
         v = 1.0 - interval(0,1).clamp(v); 
 
+        if (filter == texture_filter::bilinear)
+            return bilinear(image, 0, u, v);
+
+        if (filter == texture_filter::trilinear) {
+            // Nivel donde un texel mide lo mismo que el pixel proyectado
+            double texels = footprint * std::sqrt(double(image.width()) * image.height());
+            double lod = (texels > 1) ? std::fmin(std::log2(texels), image.levels() - 1) : 0;
+            int level = int(lod);
+            double blend = lod - level;
+            if (blend <= 0)
+                return bilinear(image, level, u, v);
+            return (1 - blend) * bilinear(image, level, u, v) + blend * bilinear(image, level + 1, u, v);
+        }
+
         auto i = int(u * image.width());
         auto j = int(v * image.height());
-        auto pixel = image.pixel_data(i,j);
+        return texel(image, 0, i, j);
+    }
+
+  private:
+    image_cache::key_type key;
+    texture_filter filter;
+    mutable std::once_flag loaded;
+    mutable std::shared_ptr<const rtw_image> image;
+
+    const rtw_image& loaded_image() const {
+        std::call_once(loaded, [this] { image = image_cache::get(key); });
+        return *image;
+    }
 
+    static color texel(const rtw_image& image, int level, int i, int j) {
+        auto pixel = image.pixel_data(level, i, j);
         auto color_scale = 1.0 / 255.0;
         return color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]);
     }
 
-  private:
-    rtw_image image;
+    // Interpolacion entre los 4 texels que rodean (u, v); los centros estan en +0.5
+    static color bilinear(const rtw_image& image, int level, double u, double v) {
+        double x = u * image.width(level) - 0.5;
+        double y = v * image.height(level) - 0.5;
+        int i = int(std::floor(x));
+        int j = int(std::floor(y));
+        double fx = x - i;
+        double fy = y - j;
+
+        return (1 - fy) * ((1 - fx) * texel(image, level, i, j)     + fx * texel(image, level, i + 1, j))
+             +      fy  * ((1 - fx) * texel(image, level, i, j + 1) + fx * texel(image, level, i + 1, j + 1));
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Cache de bloques de textura para todo el proceso, con un tope de memoria. Cada
+// bloque se lee la primera vez que se pide y, al pasarse del tope, se descarta el
+// que lleva mas tiempo sin usarse (LRU).
+//
+// Cada hilo guarda ademas los ultimos bloques que uso, asi casi ninguna lectura toca
+// el mutex. Un bloque descartado sigue vivo mientras algun hilo lo tenga guardado,
+// por eso la memoria puede pasarse del tope en unos pocos bloques por hilo.
+class tile_cache {
+  public:
+    static const int tile_size = 64;  // Pixeles por lado de un bloque
+
+    struct tile {
+        int width;                          // Menos de tile_size en el borde derecho
+        std::vector<unsigned char> pixels;  // RGB, fila por fila
+    };
+
+    // Llave de un bloque: imagen (21 bits), nivel de mipmap (5) y posicion (19 y 19)
+    static uint64_t make_key(uint32_t image, int level, int tile_x, int tile_y) {
+        return (uint64_t(image) << 43) | (uint64_t(level) << 38) | (uint64_t(tile_y) << 19) | uint64_t(tile_x);
+    }
+
+    // Identificador para las llaves de una imagen nueva
+    static uint32_t new_image_id() {
+        static std::atomic<uint32_t> next{0};
+        return next++ & ((1u << 21) - 1);
+    }
+
+    // Tope en bytes, 0 = sin tope (las texturas .rtt se mapean enteras)
+    static void set_budget(size_t bytes) {
+        tile_cache& cache = instance();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.budget_bytes = bytes;
+    }
+
+    static size_t budget() {
+        tile_cache& cache = instance();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        return cache.budget_bytes;
+    }
+
+    // Bloque con la llave; si no esta en memoria lo lee load(), que devuelve un
+    // shared_ptr<tile>. La referencia vale hasta que el mismo hilo pida otro bloque.
+    template <typename Load>
+    static const tile& fetch(uint64_t key, Load load) {
+        pin& p = pins()[(key * 0x9E3779B97F4A7C15ull) >> (64 - pin_bits)];
+        if (p.block == nullptr || p.key != key) {
+            p.block = instance().lookup(key, load);
+            p.key = key;
+        }
+        return *p.block;
+    }
+
+    // Imprime cuantos bloques se leyeron y descartaron y el maximo de memoria usado
+    static void report() {
+        tile_cache& cache = instance();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.loads == 0) return;
+        std::clog << "Bloques de textura: " << cache.loads << " leidos, " << cache.evictions << " descartados, maximo "
+                  << cache.peak / (1024.0 * 1024.0) << " MB de " << cache.budget_bytes / (1024.0 * 1024.0) << " MB\n";
+    }
+
+  private:
+    struct entry {
+        std::shared_ptr<const tile> block;
+        std::list<uint64_t>::iterator position;  // En lru
+    };
+
+    struct pin {
+        uint64_t key = 0;
+        std::shared_ptr<const tile> block;
+    };
+
+    static const int pin_bits = 4;  // 16 bloques guardados por hilo
+
+    std::unordered_map<uint64_t, entry> entries;
+    std::list<uint64_t> lru;  // El usado mas recientemente adelante
+    std::mutex mutex;
+    size_t budget_bytes = 0;
+    size_t resident = 0;
+    size_t peak = 0;
+    size_t loads = 0;
+    size_t evictions = 0;
+
+    static tile_cache& instance() {
+        static tile_cache cache;
+        return cache;
+    }
+
+    static pin* pins() {
+        static thread_local pin table[1 << pin_bits];
+        return table;
+    }
+
+    static size_t bytes_of(const tile& t) { return sizeof(tile) + t.pixels.capacity(); }
+
+    template <typename Load>
+    std::shared_ptr<const tile> lookup(uint64_t key, Load& load) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                lru.splice(lru.begin(), lru, it->second.position);
+                return it->second.block;
+            }
+        }
+
+        // Se lee sin el mutex; si otro hilo trajo el mismo bloque mientras, se usa el suyo
+        std::shared_ptr<const tile> block = load();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end())
+            return it->second.block;
+
+        lru.push_front(key);
+        entries[key] = { block, lru.begin() };
+        resident += bytes_of(*block);
+        loads++;
+
+        while (budget_bytes > 0 && resident > budget_bytes && lru.size() > 1) {
+            auto last = entries.find(lru.back());
+            resident -= bytes_of(*last->second.block);
+            entries.erase(last);
+            lru.pop_back();
+            evictions++;
+        }
+        if (resident > peak) peak = resident;
+        return block;
+    }
+};
+
+#endif
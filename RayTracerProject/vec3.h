@@ -6,18 +6,18 @@
 
 class vec3 {
   public:
-    double e[3];
+    real e[3];
 
     vec3() : e{0,0,0} {}
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    vec3(real e0, real e1, real e2) : e{e0, e1, e2} {}
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    real x() const { return e[0]; }
+    real y() const { return e[1]; }
+    real z() const { return e[2]; }
 
     vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    real operator[](int i) const { return e[i]; }
+    real& operator[](int i) { return e[i]; }
 
     vec3& operator+=(const vec3& v) {
         e[0] += v.e[0];
@@ -26,33 +26,33 @@ class vec3 {
         return *this;
     }
 
-    vec3& operator*=(double t) {
+    vec3& operator*=(real t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    vec3& operator/=(double t) {
+    vec3& operator/=(real t) {
         return *this *= 1/t;
     }
 
-    double length() const {
+    real length() const {
         return std::sqrt(length_squared());
     }
 
 		bool near_zero() const{
-			auto s = 1e-8;
+			auto s = near_zero_epsilon;
 			return (std::fabs(e[0])<s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
 		}
 
-    double length_squared() const {
+    real length_squared() const {
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
     }
 		static vec3 random(){
 			return vec3(random_double(), random_double(), random_double());
 		}
-		static vec3 random(double min, double max){
+		static vec3 random(real min, real max){
 			return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
 		}
 };
@@ -79,19 +79,19 @@ inline vec3 operator*(const vec3& u, const vec3& v) {
     return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3& v) {
+inline vec3 operator*(real t, const vec3& v) {
     return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
-inline vec3 operator*(const vec3& v, double t) {
+inline vec3 operator*(const vec3& v, real t) {
     return t * v;
 }
 
-inline vec3 operator/(const vec3& v, double t) {
+inline vec3 operator/(const vec3& v, real t) {
     return (1/t) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+inline real dot(const vec3& u, const vec3& v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
@@ -129,11 +129,34 @@ inline vec3 random_on_hemisphere(const vec3& normal){
 	else return -on_unit_sphere;
 }
 
+// Direccion en el hemisferio +z con densidad coseno/pi
+inline vec3 random_cosine_direction() {
+	auto r1 = random_double();
+	auto r2 = random_double();
+
+	auto phi = 2*pi*r1;
+	auto x = std::cos(phi) * std::sqrt(r2);
+	auto y = std::sin(phi) * std::sqrt(r2);
+	auto z = std::sqrt(1 - r2);
+	return vec3(x, y, z);
+}
+
+// Direccion alrededor de +z con densidad (n+1)/(2 pi) * cos^n, el lobulo de Phong
+inline vec3 random_phong_direction(double exponent) {
+	auto r1 = random_double();
+	auto r2 = random_double();
+
+	auto phi = 2*pi*r1;
+	auto cos_alpha = std::pow(r2, 1 / (exponent + 1));
+	auto sin_alpha = std::sqrt(std::fmax(0.0, 1 - cos_alpha*cos_alpha));
+	return vec3(std::cos(phi) * sin_alpha, std::sin(phi) * sin_alpha, cos_alpha);
+}
+
 inline vec3 reflect(const vec3& v, const vec3& n){
 	return v - 2*dot(v,n)*n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat){
+inline vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat){
 	auto cos_theta = std::fmin(dot(-uv, n), 1.0);
 	vec3 r_out_perp = etai_over_etat * (uv+cos_theta*n);
 	vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n;